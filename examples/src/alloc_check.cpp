@@ -0,0 +1,330 @@
+// Counts the heap allocations of command palette frames running in a headless ImGui context, and checks that
+// - frames where nothing changed (the query, the commands, etc.) don't allocate at all
+// - a keystroke allocates at most a fixed number of times, regardless of how many commands there are, both when it
+//   searches and when it reuses recent results (see ImCmd::SetSearchCacheSize())
+// - removing many commands between two frames drops their items all at once, and the results are carried over that
+//   single change instead of searching again
+// Both operator new and ImGui's allocator (see ImGui::SetAllocatorFunctions()) are counted, on every thread.
+//
+// Every checked configuration is printed to stdout as a JSON object on its own line. The exit code is non-zero if any of
+// the checks failed.
+//
+// Usage: imcmd-alloc-check [max item count]
+
+#include "bench_common.h"
+
+#include <imcmd_command_palette.h>
+#include <imgui.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ImCmdBench;
+
+namespace
+{
+std::atomic<bool> gCountingAllocations{ false };
+std::atomic<int> gAllocationCount{ 0 };
+
+void* CountedMalloc(std::size_t size)
+{
+    if (gCountingAllocations.load(std::memory_order_relaxed)) {
+        gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void* ImGuiCountedAlloc(size_t size, void* /*user_data*/)
+{
+    return CountedMalloc(size);
+}
+
+void ImGuiCountedFree(void* ptr, void* /*user_data*/)
+{
+    std::free(ptr);
+}
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    if (void* ptr = CountedMalloc(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return CountedMalloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return CountedMalloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+#if defined(__cpp_sized_deallocation)
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
+namespace
+{
+constexpr int kUnchangedFrames = 60;
+/// Covers one-off allocations like ImGui's text input state and the caches of the command palette filling up on the
+/// first keystrokes. Allocations that scale with the number of commands would blow way past this on large sets.
+constexpr int kMaxAllocationsPerKeystroke = 64;
+const char* const kTypedQuery = "open recent file";
+constexpr int kRemovedCommands = 100; //< More than the changes kept to carry results over, if each removal was one
+
+enum Variant
+{
+    Variant_Sync, //< Searching on the UI thread
+    Variant_Threads, //< Searching on the UI thread and 3 more
+    Variant_Background, //< Searching on a background thread
+    Variant_COUNT,
+};
+
+const char* const kVariantNames[] = { "sync", "threads", "background" };
+
+void RunFrame(const char* palette_name)
+{
+    bool open = true;
+    ImGui::NewFrame();
+    // Closed when it loses focus, there is no one to focus it here
+    ImCmd::CommandPaletteWindow(palette_name, &open);
+    ImGui::Render();
+}
+
+/// Runs frames until the search in progress (if any) is done, so that all of its allocations are accounted for.
+void RunFramesUntilSearched(const char* palette_name)
+{
+    RunFrame(palette_name);
+    while (ImCmd::IsCommandPaletteSearching(palette_name)) {
+        std::this_thread::yield();
+        RunFrame(palette_name);
+    }
+}
+
+void BeginCounting()
+{
+    gAllocationCount = 0;
+    gCountingAllocations = true;
+}
+
+int EndCounting()
+{
+    gCountingAllocations = false;
+    return gAllocationCount;
+}
+
+int CountUnchangedFrameAllocations(const char* palette_name)
+{
+    BeginCounting();
+    for (int i = 0; i < kUnchangedFrames; ++i) {
+        RunFrame(palette_name);
+    }
+    return EndCounting();
+}
+
+/// Types `c`, or presses `key` if it is 0. Returns the number of allocations until the results were updated.
+int CountKeystrokeAllocations(const char* palette_name, unsigned int c, ImGuiKey key)
+{
+    auto& io = ImGui::GetIO();
+    BeginCounting();
+    if (c != 0) {
+        io.AddInputCharacter(c);
+        RunFramesUntilSearched(palette_name);
+    } else {
+        io.AddKeyEvent(key, true);
+        RunFrame(palette_name);
+        io.AddKeyEvent(key, false);
+        RunFramesUntilSearched(palette_name);
+    }
+    return EndCounting();
+}
+
+bool CheckVariant(Variant variant, int item_count)
+{
+    auto context = ImCmd::CreateContext();
+    ImCmd::SetCurrentContext(context);
+    ImCmd::SetSearchThreadCount(variant == Variant_Threads ? 4 : 1);
+    ImCmd::SetSearchInBackground(variant == Variant_Background);
+    // Checked separately below, otherwise the second pass would only measure cache hits
+    int cache_size = ImCmd::GetSearchCacheSize();
+    ImCmd::SetSearchCacheSize(0);
+    AddCorpusCommands(MakeCorpus(CorpusStyle_Mixed, item_count));
+
+    // A window of its own, so that it appears (and focuses its search box) like it was just opened
+    char palette_name[64];
+    std::snprintf(palette_name, sizeof(palette_name), "AllocCheck %s %d", kVariantNames[variant], item_count);
+    RunFrame(palette_name);
+    RunFrame(palette_name);
+    RunFrame(palette_name);
+
+    int idle_allocations = CountUnchangedFrameAllocations(palette_name);
+
+    // Type the query, erase it and type it again. The first pass also fills up all the caches.
+    int keystroke_count = 0;
+    int keystroke_allocations = 0;
+    int max_keystroke_allocations[2] = {};
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; kTypedQuery[i] != '\0'; ++i) {
+            int count = CountKeystrokeAllocations(palette_name, static_cast<unsigned char>(kTypedQuery[i]), ImGuiKey_None);
+            keystroke_allocations += count;
+            max_keystroke_allocations[pass] = std::max(max_keystroke_allocations[pass], count);
+            ++keystroke_count;
+        }
+        if (pass == 1) {
+            break;
+        }
+        for (int i = 0; kTypedQuery[i] != '\0'; ++i) {
+            int count = CountKeystrokeAllocations(palette_name, 0, ImGuiKey_Backspace);
+            keystroke_allocations += count;
+            max_keystroke_allocations[pass] = std::max(max_keystroke_allocations[pass], count);
+            ++keystroke_count;
+        }
+    }
+
+    // Erase the query with the cache enabled, which caches the results of every prefix, then type it again
+    ImCmd::SetSearchCacheSize(cache_size);
+    int max_cached_keystroke_allocations = 0;
+    int cache_hits = 0;
+    for (int i = 0; kTypedQuery[i] != '\0'; ++i) {
+        int count = CountKeystrokeAllocations(palette_name, 0, ImGuiKey_Backspace);
+        max_cached_keystroke_allocations = std::max(max_cached_keystroke_allocations, count);
+    }
+    for (int i = 0; kTypedQuery[i] != '\0'; ++i) {
+        int count = CountKeystrokeAllocations(palette_name, static_cast<unsigned char>(kTypedQuery[i]), ImGuiKey_None);
+        max_cached_keystroke_allocations = std::max(max_cached_keystroke_allocations, count);
+        cache_hits += ImCmd::GetCommandPaletteStats(palette_name).ResultsFromCache ? 1 : 0;
+    }
+
+    // The query is left in the search box
+    int steady_allocations = CountUnchangedFrameAllocations(palette_name);
+
+    bool passed = idle_allocations == 0 &&
+        steady_allocations == 0 &&
+        max_keystroke_allocations[0] <= kMaxAllocationsPerKeystroke &&
+        max_keystroke_allocations[1] <= kMaxAllocationsPerKeystroke &&
+        max_cached_keystroke_allocations <= kMaxAllocationsPerKeystroke;
+    std::printf(
+        "{\"check\":\"allocations\",\"variant\":\"%s\",\"items\":%d,\"idle_frame_allocs\":%d,\"steady_frame_allocs\":%d,\"keystrokes\":%d,\"keystroke_allocs_avg\":%.1f,\"first_pass_keystroke_allocs_max\":%d,\"second_pass_keystroke_allocs_max\":%d,\"cached_keystroke_allocs_max\":%d,\"cache_hits\":%d,\"passed\":%s}\n",
+        kVariantNames[variant],
+        item_count,
+        idle_allocations,
+        steady_allocations,
+        keystroke_count,
+        static_cast<double>(keystroke_allocations) / keystroke_count,
+        max_keystroke_allocations[0],
+        max_keystroke_allocations[1],
+        max_cached_keystroke_allocations,
+        cache_hits,
+        passed ? "true" : "false");
+    std::fflush(stdout);
+
+    ImCmd::DestroyContext(context);
+    return passed;
+}
+
+bool CheckRemovals(int item_count)
+{
+    auto context = ImCmd::CreateContext();
+    ImCmd::SetCurrentContext(context);
+    auto corpus = MakeCorpus(CorpusStyle_Mixed, item_count);
+    AddCorpusCommands(corpus);
+
+    char palette_name[64];
+    std::snprintf(palette_name, sizeof(palette_name), "AllocCheck removals %d", item_count);
+    ImCmd::SetNextCommandPaletteSearch(kTypedQuery);
+    RunFramesUntilSearched(palette_name);
+
+    int removed_count = std::min(kRemovedCommands, item_count);
+    for (int i = 0; i < removed_count; ++i) {
+        ImCmd::RemoveCommand(corpus[static_cast<size_t>(i) * corpus.size() / removed_count].c_str());
+    }
+    RunFramesUntilSearched(palette_name);
+
+    auto stats = ImCmd::GetCommandPaletteStats(palette_name);
+    bool passed = stats.CommandCompactions == 1 && stats.ItemChangesApplied == 1;
+    std::printf(
+        "{\"check\":\"removals\",\"items\":%d,\"removed\":%d,\"compactions\":%d,\"item_changes_applied\":%d,\"passed\":%s}\n",
+        item_count,
+        removed_count,
+        stats.CommandCompactions,
+        stats.ItemChangesApplied,
+        passed ? "true" : "false");
+    std::fflush(stdout);
+
+    ImCmd::DestroyContext(context);
+    return passed;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    int max_item_count = 100000;
+    if (argc > 1) {
+        max_item_count = std::atoi(argv[1]);
+    }
+
+    // Before creating the context, so that everything ImGui allocates goes through the same functions
+    ImGui::SetAllocatorFunctions(&ImGuiCountedAlloc, &ImGuiCountedFree);
+    CreateHeadlessContext();
+    // Every keystroke has to reach the command palette in the frame it was injected, see CountKeystrokeAllocations()
+    ImGui::GetIO().ConfigInputTrickleEventQueue = false;
+
+    bool passed = true;
+    for (int item_count = 1000; item_count <= max_item_count; item_count *= 10) {
+        for (int variant = 0; variant < Variant_COUNT; ++variant) {
+            std::fprintf(stderr, "%d commands, %s\n", item_count, kVariantNames[variant]);
+            passed &= CheckVariant(static_cast<Variant>(variant), item_count);
+        }
+        std::fprintf(stderr, "%d commands, removals\n", item_count);
+        passed &= CheckRemovals(item_count);
+    }
+    if (!passed) {
+        std::fprintf(stderr, "Some checks failed, see the output for details\n");
+    }
+
+    ImGui::DestroyContext();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,215 @@
+// Headless benchmarks of the fuzzy matcher and of command palette searches, no window or GPU is needed.
+//
+// Every measurement is printed to stdout as a JSON object on its own line, so that runs can be collected and compared by
+// scripts. Progress and other human readable output goes to stderr.
+//
+// Usage: imcmd-bench [max corpus size]
+// The corpora range from 10k to 1M names by default, passing a smaller maximum makes quick runs possible.
+
+#include "bench_common.h"
+
+#include <imcmd_command_palette.h>
+#include <imcmd_fuzzy_search.h>
+#include <imgui.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ImCmdBench;
+
+namespace
+{
+constexpr int kRepetitions = 3; //< Of every query, for more latency samples
+
+enum QuerySet
+{
+    QuerySet_Short, //< 1-2 characters, matching lots of names
+    QuerySet_Long, //< Subsequences of existing names, 12+ characters
+    QuerySet_NoMatch, //< Containing characters that no name has
+    QuerySet_Pathological, //< Repeated characters, worst case of the recursive matcher
+    QuerySet_COUNT,
+};
+
+const char* const kQuerySetNames[] = { "short", "long", "no_match", "pathological" };
+
+const char* const kAlgorithmNames[] = { "recursive", "optimal" };
+
+std::vector<std::string> MakeQueries(QuerySet set, const std::vector<std::string>& corpus)
+{
+    std::mt19937 rng(54321 + set);
+    std::vector<std::string> queries;
+    switch (set) {
+        case QuerySet_Short: {
+            queries = { "o", "s", "f", "ow", "tr" };
+        } break;
+        case QuerySet_Long: {
+            // Every other character of random names, so that each query matches at least one name
+            while (queries.size() < 5) {
+                auto& name = corpus[rng() % corpus.size()];
+                std::string query;
+                for (size_t i = 0; i < name.size() && query.size() < 20; i += 2) {
+                    query += name[i];
+                }
+                if (query.size() >= 12) {
+                    queries.push_back(std::move(query));
+                }
+            }
+        } break;
+        case QuerySet_NoMatch: {
+            queries = { "q", "openj", "file_z", "render texture q", "xyzzy" };
+        } break;
+        case QuerySet_Pathological: {
+            queries = { "eeeeeeee", "aaaaaa", "ssssssss", "e_e_e_e_e", "ttttttt" };
+        } break;
+        case QuerySet_COUNT: break;
+    }
+    return queries;
+}
+
+/// Times FuzzySearch() over the whole corpus, once per query.
+void BenchFuzzySearch(const char* corpus_name, const std::vector<std::string>& corpus, QuerySet set, const std::vector<std::string>& queries)
+{
+    for (int algorithm = 0; algorithm < IM_ARRAYSIZE(kAlgorithmNames); ++algorithm) {
+        std::vector<float> latencies;
+        float total_us = 0.0f;
+        int total_matches = 0;
+        for (int repetition = 0; repetition < kRepetitions; ++repetition) {
+            for (auto& query : queries) {
+                auto start = Clock::now();
+                int matches_found = 0;
+                for (auto& name : corpus) {
+                    int score;
+                    uint16_t matches[32];
+                    int match_count;
+                    if (ImCmd::FuzzySearch(static_cast<ImCmd::FuzzySearchAlgorithm>(algorithm), query.c_str(), name.c_str(), score, matches, IM_ARRAYSIZE(matches), match_count)) {
+                        ++matches_found;
+                    }
+                }
+                float us = GetMicroseconds(Clock::now() - start);
+                latencies.push_back(us);
+                total_us += us;
+                // Same for every repetition
+                total_matches += repetition == 0 ? matches_found : 0;
+            }
+        }
+
+        double items_per_sec = total_us > 0.0f ? static_cast<double>(corpus.size()) * latencies.size() / (total_us / 1e6) : 0.0;
+        std::printf(
+            "{\"bench\":\"fuzzy_search\",\"corpus\":\"%s\",\"size\":%d,\"queries\":\"%s\",\"algorithm\":\"%s\",\"items_per_sec\":%.0f,\"matches\":%d,",
+            corpus_name,
+            static_cast<int>(corpus.size()),
+            kQuerySetNames[set],
+            kAlgorithmNames[algorithm],
+            items_per_sec,
+            total_matches);
+        PrintLatencies("", latencies);
+        std::printf("}\n");
+        std::fflush(stdout);
+    }
+}
+
+void RunFrame(const char* palette_name)
+{
+    ImGui::NewFrame();
+    ImGui::SetNextWindowSize(ImVec2(800.0f, 600.0f));
+    ImGui::Begin("Bench");
+    ImCmd::CommandPalette(palette_name);
+    ImGui::End();
+    ImGui::Render();
+}
+
+/// Times a command palette searching the corpus from scratch, once per query. The whole frame is measured as well as
+/// the search alone, see CommandPaletteStats.
+void BenchSearch(const char* corpus_name, const std::vector<std::string>& corpus, QuerySet set, const std::vector<std::string>& queries, int thread_count)
+{
+    auto context = ImCmd::CreateContext();
+    ImCmd::SetCurrentContext(context);
+    ImCmd::SetSearchThreadCount(thread_count);
+    // Every repetition has to search, not pick up the results of the previous one
+    ImCmd::SetSearchCacheSize(0);
+
+    AddCorpusCommands(corpus);
+
+    const char* palette_name = "Bench";
+    RunFrame(palette_name);
+
+    std::vector<float> frame_latencies;
+    std::vector<float> search_latencies;
+    float total_search_us = 0.0f;
+    int total_matches = 0;
+    for (int repetition = 0; repetition < kRepetitions; ++repetition) {
+        for (auto& query : queries) {
+            // Start over with an empty query every time, so that the search can't narrow down the previous results
+            ImCmd::SetNextCommandPaletteSearch("");
+            RunFrame(palette_name);
+
+            ImCmd::SetNextCommandPaletteSearch(query.c_str());
+            auto start = Clock::now();
+            RunFrame(palette_name);
+            frame_latencies.push_back(GetMicroseconds(Clock::now() - start));
+
+            auto stats = ImCmd::GetCommandPaletteStats(palette_name);
+            float search_us = stats.SearchTime + stats.SortTime;
+            search_latencies.push_back(search_us);
+            total_search_us += search_us;
+            total_matches += repetition == 0 ? stats.ResultsProduced : 0;
+        }
+    }
+
+    double items_per_sec = total_search_us > 0.0f ? static_cast<double>(corpus.size()) * search_latencies.size() / (total_search_us / 1e6) : 0.0;
+    std::printf(
+        "{\"bench\":\"search\",\"corpus\":\"%s\",\"size\":%d,\"queries\":\"%s\",\"threads\":%d,\"items_per_sec\":%.0f,\"matches\":%d,",
+        corpus_name,
+        static_cast<int>(corpus.size()),
+        kQuerySetNames[set],
+        thread_count,
+        items_per_sec,
+        total_matches);
+    PrintLatencies("", search_latencies);
+    std::printf(",");
+    PrintLatencies("frame_", frame_latencies);
+    std::printf("}\n");
+    std::fflush(stdout);
+
+    ImCmd::DestroyContext(context);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    int max_corpus_size = 1000000;
+    if (argc > 1) {
+        max_corpus_size = std::atoi(argv[1]);
+    }
+
+    CreateHeadlessContext();
+
+    std::vector<int> thread_counts = { 1 };
+    if (std::thread::hardware_concurrency() > 1) {
+        thread_counts.push_back(static_cast<int>(std::thread::hardware_concurrency()));
+    }
+
+    for (int size = 10000; size <= max_corpus_size; size *= 10) {
+        for (int style = 0; style < CorpusStyle_COUNT; ++style) {
+            auto corpus_name = kCorpusStyleNames[style];
+            std::fprintf(stderr, "Corpus %s, %d names\n", corpus_name, size);
+            auto corpus = MakeCorpus(static_cast<CorpusStyle>(style), size);
+
+            for (int set = 0; set < QuerySet_COUNT; ++set) {
+                auto queries = MakeQueries(static_cast<QuerySet>(set), corpus);
+                BenchFuzzySearch(corpus_name, corpus, static_cast<QuerySet>(set), queries);
+                for (int thread_count : thread_counts) {
+                    BenchSearch(corpus_name, corpus, static_cast<QuerySet>(set), queries, thread_count);
+                }
+            }
+        }
+    }
+
+    ImGui::DestroyContext();
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "bench_common.h"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <unordered_set>
+
+namespace ImCmdBench
+{
+namespace
+{
+const char* const kWords[] = {
+    "open", "close", "save", "load", "file", "window", "toggle", "render", "texture", "shader",
+    "mesh", "scene", "asset", "editor", "settings", "recent", "workspace", "build", "debug", "profile",
+    "layer", "material", "light", "camera", "export", "import", "select", "all", "node", "graph",
+    "animation", "timeline", "console", "output", "search", "replace", "format", "document", "theme", "font",
+    "player", "physics", "collision", "audio", "network", "server", "client", "cache", "memory", "thread",
+};
+const char* const kExtensions[] = { ".png", ".cpp", ".h", ".ini", ".wav", ".fbx" };
+
+std::string MakeName(std::mt19937& rng, CorpusStyle style)
+{
+    auto random_word = [&]() -> std::string {
+        return kWords[rng() % IM_ARRAYSIZE(kWords)];
+    };
+
+    if (style == CorpusStyle_Mixed) {
+        int pick = rng() % 4;
+        if (pick < 3) {
+            return MakeName(rng, static_cast<CorpusStyle>(pick));
+        }
+        // Command-like, e.g. "Open recent file"
+        std::string name = random_word();
+        name[0] = static_cast<char>(name[0] - 'a' + 'A');
+        int word_count = 1 + rng() % 5;
+        for (int i = 0; i < word_count; ++i) {
+            name += ' ';
+            name += random_word();
+        }
+        return name;
+    }
+
+    std::string name;
+    int word_count = 1 + rng() % 6;
+    if (style == CorpusStyle_Path) {
+        int dir_count = 1 + rng() % 4;
+        for (int i = 0; i < dir_count; ++i) {
+            name += random_word();
+            name += '/';
+        }
+    }
+    for (int i = 0; i < word_count; ++i) {
+        auto word = random_word();
+        if (i > 0) {
+            if (style == CorpusStyle_CamelCase) {
+                word[0] = static_cast<char>(word[0] - 'a' + 'A');
+            } else {
+                name += '_';
+            }
+        }
+        name += word;
+    }
+    if (style == CorpusStyle_Path) {
+        name += kExtensions[rng() % IM_ARRAYSIZE(kExtensions)];
+    }
+    return name;
+}
+} // namespace
+
+const char* const kCorpusStyleNames[CorpusStyle_COUNT] = { "camel_case", "snake_case", "path", "mixed" };
+
+std::vector<std::string> MakeCorpus(CorpusStyle style, int count)
+{
+    std::mt19937 rng(12345 + style);
+    std::unordered_set<std::string> seen;
+    std::vector<std::string> corpus;
+    corpus.reserve(count);
+    while (static_cast<int>(corpus.size()) < count) {
+        auto name = MakeName(rng, style);
+        if (seen.size() >= static_cast<size_t>(count) / 2 || !seen.insert(name).second) {
+            // Random word combinations run out eventually, numbering keeps the names distinct
+            name += ' ';
+            name += std::to_string(corpus.size());
+        }
+        corpus.push_back(std::move(name));
+    }
+    return corpus;
+}
+
+void AddCorpusCommands(const std::vector<std::string>& corpus)
+{
+    std::vector<ImCmd::Command> commands(corpus.size());
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        commands[i].Name = corpus[i];
+    }
+    ImCmd::AddCommands(std::move(commands));
+}
+
+void CreateHeadlessContext()
+{
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    auto& io = ImGui::GetIO();
+    io.DisplaySize = ImVec2(1280.0f, 720.0f);
+    io.DeltaTime = 1.0f / 60.0f;
+    io.IniFilename = nullptr;
+    // Building the font atlas is all ImGui needs for NewFrame(), there is nothing to upload it to
+    unsigned char* pixels;
+    int width, height;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+}
+
+float GetMicroseconds(Clock::duration duration)
+{
+    return std::chrono::duration<float, std::micro>(duration).count();
+}
+
+float GetPercentile(const std::vector<float>& sorted_values, int percentile)
+{
+    if (sorted_values.empty()) {
+        return 0.0f;
+    }
+    size_t rank = (sorted_values.size() * percentile + 99) / 100;
+    return sorted_values[std::max<size_t>(rank, 1) - 1];
+}
+
+void PrintLatencies(const char* prefix, std::vector<float> latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    std::printf(
+        "\"%sp50_us\":%.1f,\"%sp90_us\":%.1f,\"%sp95_us\":%.1f,\"%sp99_us\":%.1f,\"%smax_us\":%.1f",
+        prefix,
+        GetPercentile(latencies, 50),
+        prefix,
+        GetPercentile(latencies, 90),
+        prefix,
+        GetPercentile(latencies, 95),
+        prefix,
+        GetPercentile(latencies, 99),
+        prefix,
+        latencies.empty() ? 0.0f : latencies.back());
+}
+} // namespace ImCmdBench
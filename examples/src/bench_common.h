@@ -0,0 +1,41 @@
+// Helpers shared by the headless benchmark tools
+#pragma once
+
+#include <imcmd_command_palette.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace ImCmdBench
+{
+using Clock = std::chrono::steady_clock;
+
+enum CorpusStyle
+{
+    CorpusStyle_CamelCase, //< openRecentFile
+    CorpusStyle_SnakeCase, //< open_recent_file
+    CorpusStyle_Path, //< assets/open/recent_file.png
+    CorpusStyle_Mixed, //< All of the above, plus command-like names such as "Open recent file"
+    CorpusStyle_COUNT,
+};
+
+extern const char* const kCorpusStyleNames[CorpusStyle_COUNT];
+
+/// Generates `count` distinct names, the same ones for the same arguments. None of them contain 'j', 'q' or 'z', so
+/// that queries with those letters never match.
+std::vector<std::string> MakeCorpus(CorpusStyle style, int count);
+/// Registers a command for each name in the current ImCmd context.
+void AddCorpusCommands(const std::vector<std::string>& corpus);
+
+/// Creates an ImGui context that runs without any platform or renderer backend, with a fake display and the default
+/// font.
+void CreateHeadlessContext();
+
+float GetMicroseconds(Clock::duration duration);
+/// Nearest-rank percentile of `sorted_values`.
+float GetPercentile(const std::vector<float>& sorted_values, int percentile);
+/// Prints the JSON fields about the distribution of `latencies` (in microseconds), each name starting with `prefix`,
+/// without the enclosing braces.
+void PrintLatencies(const char* prefix, std::vector<float> latencies);
+} // namespace ImCmdBench
@@ -81,6 +81,7 @@ int main()
     bool show_demo_window = true;
     bool show_command_palette = false;
     bool show_custom_command_palette = false;
+    bool show_command_palette_stats = false;
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
     ImCmd::Command toggle_demo_cmd;
@@ -90,6 +91,15 @@ int main()
     };
     ImCmd::AddCommand(std::move(toggle_demo_cmd));
 
+    // Function pointer callbacks, which don't allocate unlike capturing lambdas in std::function
+    ImCmd::Command reset_clear_color_cmd;
+    reset_clear_color_cmd.Name = "Reset background color";
+    reset_clear_color_cmd.InitialCallbackFn = [](void* user_data) {
+        *static_cast<ImVec4*>(user_data) = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
+    };
+    reset_clear_color_cmd.UserData = &clear_color;
+    ImCmd::AddCommand(std::move(reset_clear_color_cmd));
+
     ImCmd::Command select_theme_cmd;
     select_theme_cmd.Name = "Select theme";
     select_theme_cmd.InitialCallback = [&]() {
@@ -206,6 +216,10 @@ int main()
             ImGui::End();
         }
 
+        if (show_command_palette_stats) {
+            ImCmd::ShowCommandPaletteStatsWindow("CommandPalette", &show_command_palette_stats);
+        }
+
         ImGui::Begin("Config", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
         {
             char label[] = "Context X";
@@ -245,6 +259,7 @@ int main()
                 ImCmd::SetStyleColor(ImCmdTextType_Highlight, ImGui::ColorConvertFloat4ToU32(highlight_font_color));
             }
         }
+        ImGui::Checkbox("Show stats of the default command palette", &show_command_palette_stats);
         ImGui::End();
 
         ImGui::Render();
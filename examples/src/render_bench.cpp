@@ -0,0 +1,189 @@
+// Headless benchmark of whole command palette frames: layout, draw list emission and everything else
+// CommandPaletteWindow() does, measured without any window or GPU.
+//
+// Every scripted scenario is printed to stdout as a JSON object on its own line, with the CPU time per frame and the
+// size of the resulting ImDrawData. Progress and other human readable output goes to stderr.
+//
+// Usage: imcmd-render-bench [max item count]
+
+#include "bench_common.h"
+
+#include <imcmd_command_palette.h>
+#include <imgui.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace ImCmdBench;
+
+namespace
+{
+constexpr int kScenarioFrames = 240;
+const char* const kPaletteName = "RenderBench";
+
+enum Scenario
+{
+    Scenario_Idle, //< Empty query, all commands listed
+    Scenario_Typing, //< One character typed per frame, starting over after each query
+    Scenario_Steady, //< A query matching lots of commands, unchanged
+    Scenario_Navigating, //< Same as Scenario_Steady, while holding the down arrow key
+    Scenario_COUNT,
+};
+
+const char* const kScenarioNames[] = { "idle", "typing", "steady", "navigating" };
+
+const char* const kTypedQueries[] = { "open recent file", "render_texture", "assets/mesh.fbx", "toggle console" };
+
+struct FrameSample
+{
+    float Time; //< Microseconds from NewFrame() to Render()
+    int VertexCount;
+    int IndexCount;
+    int DrawCommandCount;
+    ImCmd::CommandPaletteStats Stats;
+};
+
+/// Sets up the inputs of frame `frame` of `scenario`.
+void ScriptFrame(Scenario scenario, int frame)
+{
+    auto& io = ImGui::GetIO();
+    switch (scenario) {
+        case Scenario_Idle: {
+            if (frame == 0) {
+                ImCmd::SetNextCommandPaletteSearch("");
+            }
+        } break;
+        case Scenario_Typing: {
+            // Cycle through the queries, clearing the search box in between. The text is only read by the next
+            // CommandPalette() call, so it has to outlive this function.
+            static std::string typed_text;
+            int frame_in_cycle = frame;
+            for (int i = 0;; i = (i + 1) % IM_ARRAYSIZE(kTypedQueries)) {
+                std::string query = kTypedQueries[i];
+                int cycle_length = static_cast<int>(query.size()) + 1;
+                if (frame_in_cycle < cycle_length) {
+                    typed_text = query.substr(0, frame_in_cycle);
+                    ImCmd::SetNextCommandPaletteSearch(typed_text.c_str());
+                    break;
+                }
+                frame_in_cycle -= cycle_length;
+            }
+        } break;
+        case Scenario_Steady: {
+            if (frame == 0) {
+                ImCmd::SetNextCommandPaletteSearch("e");
+            }
+        } break;
+        case Scenario_Navigating: {
+            if (frame == 0) {
+                ImCmd::SetNextCommandPaletteSearch("e");
+            }
+            // Key repeat isn't simulated, so press and release every other frame instead
+            io.AddKeyEvent(ImGuiKey_DownArrow, frame % 2 == 0);
+        } break;
+        case Scenario_COUNT: break;
+    }
+}
+
+FrameSample RunFrame()
+{
+    FrameSample sample;
+    bool open = true;
+
+    auto start = Clock::now();
+    ImGui::NewFrame();
+    // Closed when it loses focus, there is no one to focus it here
+    ImCmd::CommandPaletteWindow(kPaletteName, &open);
+    ImGui::Render();
+    sample.Time = GetMicroseconds(Clock::now() - start);
+
+    auto draw_data = ImGui::GetDrawData();
+    sample.VertexCount = draw_data->TotalVtxCount;
+    sample.IndexCount = draw_data->TotalIdxCount;
+    sample.DrawCommandCount = 0;
+    for (int i = 0; i < draw_data->CmdListsCount; ++i) {
+        sample.DrawCommandCount += draw_data->CmdLists[i]->CmdBuffer.Size;
+    }
+    sample.Stats = ImCmd::GetCommandPaletteStats(kPaletteName);
+    return sample;
+}
+
+void BenchScenario(Scenario scenario, int item_count)
+{
+    // Warm up, e.g. the window appearing and the initial list of commands
+    ImCmd::SetNextCommandPaletteSearch("");
+    RunFrame();
+    RunFrame();
+
+    std::vector<FrameSample> samples;
+    samples.reserve(kScenarioFrames);
+    for (int frame = 0; frame < kScenarioFrames; ++frame) {
+        ScriptFrame(scenario, frame);
+        samples.push_back(RunFrame());
+    }
+    // Leave no key held down for the next scenario
+    ImGui::GetIO().AddKeyEvent(ImGuiKey_DownArrow, false);
+    RunFrame();
+
+    std::vector<float> frame_times;
+    std::vector<float> layout_times;
+    std::vector<float> draw_times;
+    double vertex_sum = 0, index_sum = 0, draw_command_sum = 0;
+    int vertex_max = 0;
+    for (auto& sample : samples) {
+        frame_times.push_back(sample.Time);
+        layout_times.push_back(sample.Stats.LayoutTime);
+        draw_times.push_back(sample.Stats.DrawTime);
+        vertex_sum += sample.VertexCount;
+        index_sum += sample.IndexCount;
+        draw_command_sum += sample.DrawCommandCount;
+        vertex_max = std::max(vertex_max, sample.VertexCount);
+    }
+
+    std::printf(
+        "{\"bench\":\"render\",\"scenario\":\"%s\",\"items\":%d,\"frames\":%d,\"vertices_avg\":%.1f,\"vertices_max\":%d,\"indices_avg\":%.1f,\"draw_cmds_avg\":%.1f,",
+        kScenarioNames[scenario],
+        item_count,
+        kScenarioFrames,
+        vertex_sum / kScenarioFrames,
+        vertex_max,
+        index_sum / kScenarioFrames,
+        draw_command_sum / kScenarioFrames);
+    PrintLatencies("frame_", frame_times);
+    std::printf(",");
+    PrintLatencies("layout_", layout_times);
+    std::printf(",");
+    PrintLatencies("draw_", draw_times);
+    std::printf("}\n");
+    std::fflush(stdout);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    int max_item_count = 100000;
+    if (argc > 1) {
+        max_item_count = std::atoi(argv[1]);
+    }
+
+    CreateHeadlessContext();
+
+    for (int item_count = 100; item_count <= max_item_count; item_count *= 10) {
+        std::fprintf(stderr, "%d commands\n", item_count);
+        auto context = ImCmd::CreateContext();
+        ImCmd::SetCurrentContext(context);
+        AddCorpusCommands(MakeCorpus(CorpusStyle_Mixed, item_count));
+
+        for (int scenario = 0; scenario < Scenario_COUNT; ++scenario) {
+            BenchScenario(static_cast<Scenario>(scenario), item_count);
+        }
+
+        ImCmd::DestroyContext(context);
+    }
+
+    ImGui::DestroyContext();
+    return 0;
+}
@@ -0,0 +1,288 @@
+// Replays recorded typing sessions into a command palette running in a headless ImGui context, and reports the latency
+// from each keystroke to the command palette showing the results that take it into account.
+//
+// Usage: imcmd-replay <session file>...
+//
+// Each session is printed to stdout as a JSON object on its own line. Session files are plain text, one directive or
+// event per line, blank lines and lines starting with '#' are ignored:
+//
+//     corpus <camel_case|snake_case|path|mixed> <count>   Commands to search, see MakeCorpus(). Default mixed 10000.
+//     algorithm <recursive|optimal>                       See SetSearchAlgorithm().
+//     threads <count>                                     See SetSearchThreadCount().
+//     background <0|1>                                    See SetSearchInBackground().
+//     time_budget <microseconds>                          See SetSearchTimeBudget().
+//     item_budget <count>                                 See SetSearchItemBudget().
+//     max_results <count>                                 See SetMaxSearchResults().
+//     cache_size <bytes>                                  See SetSearchCacheSize().
+//     <milliseconds> char <c>                             Types the character `c`, or a space for "char space".
+//     <milliseconds> key <Backspace|Delete|Up|Down|Left|Right|Home|End>
+//
+// Event times are relative to the start of the session, and must not decrease. Sessions are replayed in real time,
+// except that idle periods (no search running, nothing to show) are skipped.
+
+#include "bench_common.h"
+
+#include <imcmd_command_palette.h>
+#include <imgui.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ImCmdBench;
+
+namespace
+{
+struct KeyName
+{
+    const char* Name;
+    ImGuiKey Key;
+};
+
+const KeyName kKeyNames[] = {
+    { "Backspace", ImGuiKey_Backspace },
+    { "Delete", ImGuiKey_Delete },
+    { "Up", ImGuiKey_UpArrow },
+    { "Down", ImGuiKey_DownArrow },
+    { "Left", ImGuiKey_LeftArrow },
+    { "Right", ImGuiKey_RightArrow },
+    { "Home", ImGuiKey_Home },
+    { "End", ImGuiKey_End },
+};
+
+struct SessionEvent
+{
+    double Time; //< Milliseconds since the start of the session
+    unsigned int Char; //< Typed character, or 0 if this is a key press
+    ImGuiKey Key;
+};
+
+struct Session
+{
+    std::string Name;
+    CorpusStyle Style = CorpusStyle_Mixed;
+    int CorpusSize = 10000;
+    ImCmd::FuzzySearchAlgorithm Algorithm = ImCmd::FuzzySearchAlgorithm_Recursive;
+    int ThreadCount = 1;
+    bool SearchInBackground = false;
+    int TimeBudget = 0;
+    int ItemBudget = 0;
+    int MaxResults = 0;
+    int CacheSize = 4 * 1024 * 1024;
+    std::vector<SessionEvent> Events;
+};
+
+bool ParseSession(const char* path, Session& session)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::fprintf(stderr, "%s: cannot open file\n", path);
+        return false;
+    }
+
+    session.Name = path;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        std::istringstream words(line);
+        std::string first;
+        if (!(words >> first) || first[0] == '#') {
+            continue;
+        }
+
+        bool valid = true;
+        std::string argument;
+        if (first == "corpus") {
+            valid = false;
+            words >> argument >> session.CorpusSize;
+            for (int i = 0; i < CorpusStyle_COUNT; ++i) {
+                if (argument == kCorpusStyleNames[i]) {
+                    session.Style = static_cast<CorpusStyle>(i);
+                    valid = !words.fail();
+                }
+            }
+        } else if (first == "algorithm") {
+            words >> argument;
+            if (argument == "recursive") {
+                session.Algorithm = ImCmd::FuzzySearchAlgorithm_Recursive;
+            } else if (argument == "optimal") {
+                session.Algorithm = ImCmd::FuzzySearchAlgorithm_Optimal;
+            } else {
+                valid = false;
+            }
+        } else if (first == "threads") {
+            valid = static_cast<bool>(words >> session.ThreadCount);
+        } else if (first == "background") {
+            valid = static_cast<bool>(words >> session.SearchInBackground);
+        } else if (first == "time_budget") {
+            valid = static_cast<bool>(words >> session.TimeBudget);
+        } else if (first == "item_budget") {
+            valid = static_cast<bool>(words >> session.ItemBudget);
+        } else if (first == "max_results") {
+            valid = static_cast<bool>(words >> session.MaxResults);
+        } else if (first == "cache_size") {
+            valid = static_cast<bool>(words >> session.CacheSize);
+        } else {
+            SessionEvent event = {};
+            event.Time = std::atof(first.c_str());
+            std::string type;
+            words >> type >> argument;
+            if (type == "char" && argument == "space") {
+                event.Char = ' ';
+            } else if (type == "char" && argument.size() == 1) {
+                event.Char = static_cast<unsigned char>(argument[0]);
+            } else if (type == "key") {
+                valid = false;
+                for (auto& key_name : kKeyNames) {
+                    if (argument == key_name.Name) {
+                        event.Key = key_name.Key;
+                        valid = true;
+                    }
+                }
+            } else {
+                valid = false;
+            }
+            if (!session.Events.empty() && event.Time < session.Events.back().Time) {
+                valid = false;
+            }
+            if (valid) {
+                session.Events.push_back(event);
+            }
+        }
+
+        if (!valid) {
+            std::fprintf(stderr, "%s:%d: invalid line '%s'\n", path, line_number, line.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void RunFrame(const char* palette_name)
+{
+    bool open = true;
+    ImGui::NewFrame();
+    // Closed when an item gets selected or it loses focus, keep it open regardless
+    ImCmd::CommandPaletteWindow(palette_name, &open);
+    ImGui::Render();
+}
+
+void ReplaySession(const Session& session)
+{
+    auto context = ImCmd::CreateContext();
+    ImCmd::SetCurrentContext(context);
+    ImCmd::SetSearchAlgorithm(session.Algorithm);
+    ImCmd::SetSearchThreadCount(session.ThreadCount);
+    ImCmd::SetSearchInBackground(session.SearchInBackground);
+    ImCmd::SetSearchTimeBudget(session.TimeBudget);
+    ImCmd::SetSearchItemBudget(session.ItemBudget);
+    ImCmd::SetMaxSearchResults(session.MaxResults);
+    ImCmd::SetSearchCacheSize(session.CacheSize);
+    AddCorpusCommands(MakeCorpus(session.Style, session.CorpusSize));
+
+    // A window of its own, so that it appears (and focuses its search box) like it was just opened
+    const char* palette_name = session.Name.c_str();
+    RunFrame(palette_name);
+    RunFrame(palette_name);
+
+    auto& io = ImGui::GetIO();
+    std::vector<Clock::time_point> pending_keystrokes; //< Injection time of the keystrokes whose results aren't shown yet
+    std::vector<float> latencies;
+    ImGuiKey held_key = ImGuiKey_None;
+    int frame_count = 0;
+
+    auto start_time = Clock::now();
+    Clock::duration skipped_time{};
+    size_t next_event = 0;
+    while (next_event < session.Events.size() || !pending_keystrokes.empty()) {
+        auto session_time = std::chrono::duration<double, std::milli>(Clock::now() - start_time + skipped_time).count();
+        bool idle = pending_keystrokes.empty() && !ImCmd::IsCommandPaletteSearching(palette_name) && held_key == ImGuiKey_None;
+        if (idle && next_event < session.Events.size() && session.Events[next_event].Time > session_time) {
+            skipped_time += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(session.Events[next_event].Time - session_time));
+            session_time = session.Events[next_event].Time;
+        }
+
+        if (held_key != ImGuiKey_None) {
+            io.AddKeyEvent(held_key, false);
+            held_key = ImGuiKey_None;
+        }
+        // One key press per frame, so that it gets released in between
+        while (next_event < session.Events.size() && session.Events[next_event].Time <= session_time && held_key == ImGuiKey_None) {
+            auto& event = session.Events[next_event++];
+            if (event.Char != 0) {
+                io.AddInputCharacter(event.Char);
+            } else {
+                io.AddKeyEvent(event.Key, true);
+                held_key = event.Key;
+            }
+            pending_keystrokes.push_back(Clock::now());
+        }
+
+        RunFrame(palette_name);
+        ++frame_count;
+
+        if (!ImCmd::IsCommandPaletteSearching(palette_name)) {
+            auto now = Clock::now();
+            for (auto injection_time : pending_keystrokes) {
+                latencies.push_back(GetMicroseconds(now - injection_time));
+            }
+            pending_keystrokes.clear();
+        } else if (session.SearchInBackground) {
+            // Frames are run back to back, don't keep the search thread from running on machines with few cores
+            std::this_thread::yield();
+        }
+    }
+    // Don't leave the last key held down for the next session
+    if (held_key != ImGuiKey_None) {
+        io.AddKeyEvent(held_key, false);
+        RunFrame(palette_name);
+    }
+
+    std::printf(
+        "{\"session\":\"%s\",\"corpus\":\"%s\",\"size\":%d,\"keystrokes\":%d,\"frames\":%d,",
+        session.Name.c_str(),
+        kCorpusStyleNames[session.Style],
+        session.CorpusSize,
+        static_cast<int>(latencies.size()),
+        frame_count);
+    PrintLatencies("", latencies);
+    std::printf("}\n");
+    std::fflush(stdout);
+
+    ImCmd::DestroyContext(context);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <session file>...\n", argv[0]);
+        return 1;
+    }
+
+    CreateHeadlessContext();
+    // Every event has to reach the command palette in the frame it was injected, or its latency would be cut short
+    ImGui::GetIO().ConfigInputTrickleEventQueue = false;
+
+    int exit_code = 0;
+    for (int i = 1; i < argc; ++i) {
+        Session session;
+        if (!ParseSession(argv[i], session)) {
+            exit_code = 1;
+            continue;
+        }
+        std::fprintf(stderr, "Replaying %s\n", argv[i]);
+        ReplaySession(session);
+    }
+
+    ImGui::DestroyContext();
+    return exit_code;
+}
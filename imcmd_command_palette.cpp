@@ -8,14 +8,27 @@
 #include "imcmd_fuzzy_search.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
 // NOTE: we try to use as much ImGui's helpers as possible, in order to reduce
 // work if the end user decide to swap out some standard library functions for
 // their own.
 #include <cstring>
+#include <iterator>
 #include <limits>
+#include <mutex>
+#include <thread>
 #include <utility>
 
+// Performance counters are only ever updated through this, define IMCMD_DISABLE_STATS to strip them
+#if !defined(IMCMD_DISABLE_STATS)
+#    define IMCMD_STATS(expr) expr
+#else
+#    define IMCMD_STATS(expr) ((void)0)
+#endif
+
 namespace ImCmd
 {
 // =================================================================
@@ -25,25 +38,72 @@ namespace ImCmd
 struct StackFrame;
 class ExecutionManager;
 
+class StatsTimer;
+
 struct SearchResult;
+struct SearchSettings;
+class SearchJob;
+class BackgroundSearchWorker;
 class SearchManager;
+class SearchWorkerPool;
 
+class CommandNameIndex;
+struct CommandItemStorage;
 struct CommandOperationRegister;
 struct CommandOperationUnregister;
 struct CommandOperation;
 struct Context;
 
 struct ItemExtraData;
+struct RowSegment;
+struct RowLayout;
+class RowLayoutCache;
 struct Instance;
 
 // =================================================================
 // Private interface
 // =================================================================
 
+struct OptionStream
+{
+    std::mutex Mutex;
+    std::vector<std::string> PendingOptions; //< Appended, but not picked up by the command palette yet
+    std::atomic<int> RefCount{ 2 }; //< Held by the producer until FinishOptions(), and by the prompt until it ends
+    std::atomic<bool> Closed{ false }; //< Whether the prompt has ended
+    std::atomic<bool> Finished{ false }; //< Whether the producer is done
+};
+
+static void ReleaseOptionStream(OptionStream* stream)
+{
+    if (--stream->RefCount == 0) {
+        delete stream;
+    }
+}
+
 struct StackFrame
 {
     std::vector<std::string> Options;
+    std::vector<uint64_t> OptionSignatures; //< FuzzySearchSignature() of each option
+    std::vector<uint32_t> FoldedOptionOffsets; //< Where each option's FuzzySearchFoldCase() form starts in FoldedOptionArena
+    std::vector<char> FoldedOptionArena;
+    // Used instead of Options when prompting over an option source
+    OptionGetter Getter = nullptr;
+    void* GetterUserData = nullptr;
+    int GetterOptionCount = 0;
+    OptionStream* Stream = nullptr; //< Where more Options come from, if any
     int SelectedOption = -1;
+
+    const char* GetFoldedOption(int option) const { return FoldedOptionArena.data() + FoldedOptionOffsets[option]; }
+
+    /// Computes the search data of `option`, which must be the next one in Options.
+    void AddOptionSearchData(const std::string& option)
+    {
+        auto offset = static_cast<uint32_t>(FoldedOptionArena.size());
+        FoldedOptionArena.resize(FoldedOptionArena.size() + option.size() + 1);
+        FuzzySearchFoldCase(option.c_str(), FoldedOptionArena.data() + offset);
+        FoldedOptionOffsets.push_back(offset);
+        OptionSignatures.push_back(FuzzySearchSignature(FoldedOptionArena.data() + offset));
+    }
 };
 
 class ExecutionManager
@@ -52,16 +112,31 @@ private:
     Instance* m_Instance;
     Command* m_ExecutingCommand = nullptr;
     std::vector<StackFrame> m_CallStack;
+    std::vector<std::string> m_ReceivedOptions; //< Staging buffer for options picked up from an OptionStream
 
 public:
     ExecutionManager(Instance& instance)
         : m_Instance{ &instance } {}
 
+    ~ExecutionManager();
+
     int GetItemCount() const;
     const char* GetItem(int idx) const;
+    /// Returns the FuzzySearchFoldCase() form of the item, or null if it has to be folded while searching.
+    const char* GetFoldedItem(int idx) const;
+    uint64_t GetItemSignature(int idx) const;
     void SelectItem(int idx);
 
     void PushOptions(std::vector<std::string> options);
+    void PushOptions(int count, OptionGetter getter, void* user_data);
+    OptionStream* PushOptionStream();
+
+    /// Appends the options that arrived through the current prompt's OptionStream (if any) since the last call.
+    void ReceiveOptions();
+    bool IsReceivingOptions() const; //< Whether more options might arrive through the current prompt's OptionStream
+
+private:
+    void ClearCallStack();
 };
 
 struct SearchResult
@@ -69,13 +144,246 @@ struct SearchResult
     int ItemIndex;
     int Score;
     int MatchCount;
-    uint8_t Matches[32];
+    uint16_t Matches[32]; //< Byte offset of each matched character in the item's text
+};
+
+/// Packs the ranking order of a search result into one integer: score in the high half, and the item index inverted in
+/// the low half, so that ties are broken by item order. Bigger keys rank first.
+static uint64_t GetRankKey(const SearchResult& result)
+{
+    // Flipping the sign bit maps signed order onto unsigned order
+    auto score_bits = static_cast<uint32_t>(result.Score) ^ 0x80000000u;
+    auto index_bits = ~static_cast<uint32_t>(result.ItemIndex);
+    return static_cast<uint64_t>(score_bits) << 32 | index_bits;
+}
+
+/// Ranking order of search results: biggest score first, ties broken by item order.
+static bool IsRankedBefore(const SearchResult& a, const SearchResult& b)
+{
+    return GetRankKey(a) > GetRankKey(b);
+}
+
+#if !defined(IMCMD_DISABLE_STATS)
+static float GetMicrosecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// Adds the time until it goes out of scope to a counter, in microseconds.
+class StatsTimer
+{
+private:
+    float* m_Total;
+    std::chrono::steady_clock::time_point m_Start;
+
+public:
+    StatsTimer(float& total)
+        : m_Total{ &total }
+        , m_Start{ std::chrono::steady_clock::now() }
+    {
+    }
+
+    ~StatsTimer() { *m_Total += GetMicrosecondsSince(m_Start); }
+};
+
+/// Adds the counters of a part of a search to those of the whole search. Timings are measured for the whole search.
+static void AddSearchStats(CommandPaletteStats& total, const CommandPaletteStats& part)
+{
+    total.CandidatesScanned += part.CandidatesScanned;
+    total.PrefilterRejections += part.PrefilterRejections;
+    total.MatcherCalls += part.MatcherCalls;
+    total.MatcherRecursions += part.MatcherRecursions;
+    total.ResultsProduced += part.ResultsProduced;
+}
+#endif
+
+/// Everything a search needs from the context, captured when it starts so that it can run on another thread.
+struct SearchSettings
+{
+    FuzzySearchAlgorithm Algorithm = FuzzySearchAlgorithm_Recursive;
+    SearchWorkerPool* Workers = nullptr;
+    int Generation = -1; //< Context::CommandSetGeneration of the items being searched
+    int MaxResults = 0; //< Only the best this many matches are kept, 0 for unlimited
+};
+
+/// A search for one query over the items of an instance. It is advanced in steps, so it can span multiple frames or
+/// be cancelled midway; the ranked results found so far are kept in the vector given to Restart().
+class SearchJob
+{
+private:
+    Instance* m_Instance;
+    std::vector<SearchResult>* m_Results = nullptr;
+    char m_SearchText[std::numeric_limits<uint8_t>::max() + 1] = {};
+    char m_FoldedSearchText[std::numeric_limits<uint8_t>::max() + 1] = {};
+    SearchSettings m_Settings;
+
+    // The query (and command set) of the last completed search, used for narrowing its results down incrementally.
+    // Its results are in *m_Results, or in m_Candidates while a search narrowing them down is in progress.
+    char m_LastSearchText[std::numeric_limits<uint8_t>::max() + 1] = {}; //< Folded
+    int m_LastSearchGeneration = -1;
+    int m_LastSearchItemCount = 0; //< Items appended after these are not covered by the results yet
+
+    // State of the search in progress
+    std::vector<SearchResult> m_Candidates; //< Results of the last completed search, if narrowing them down
+    uint64_t m_SearchSignature = 0;
+    int m_CandidateCount = 0;
+    int m_NextCandidate = 0;
+    int m_ItemCount = 0; //< Number of items covered by the candidates
+    bool m_Narrowing = false;
+    bool m_Searching = false;
+    bool m_Truncated = false; //< Whether matches were dropped because of SearchSettings::MaxResults
+    CommandPaletteStats m_Stats; //< Only the fields about searching are used
+
+    // Each step of a search is split into chunks that can be scored in parallel
+    std::vector<std::vector<SearchResult>> m_ChunkResults;
+    std::vector<char> m_ChunkTruncated; //< Not a std::vector<bool>, each chunk's flag is written by a different thread
+    std::vector<CommandPaletteStats> m_ChunkStats;
+    std::vector<SearchResult> m_MergeBuffer;
+    std::vector<int> m_RunEnds;
+    int m_StepEnd = 0;
+    int m_ChunkSize = 0;
+
+public:
+    SearchJob(Instance& instance)
+        : m_Instance{ &instance }
+    {
+    }
+
+    bool IsSearching() const { return m_Searching; }
+    bool IsTruncated() const { return m_Truncated; }
+    const CommandPaletteStats& GetStats() const { return m_Stats; }
+    int GetStepSize() const;
+
+    /// Starts searching for `text`, discarding the search in progress (if any). `results` must be the same vector
+    /// across calls, unless Reset() was called in between.
+    void Restart(const char* text, const SearchSettings& settings, std::vector<SearchResult>& results);
+    /// Takes `results`, e.g. from a cache, as the completed results of searching for `text` over the current items,
+    /// discarding the search in progress (if any). Later searches narrow them down like any others.
+    void Assign(const char* text, const SearchSettings& settings, std::vector<SearchResult>& results, bool truncated, const CommandPaletteStats& stats);
+    /// Carries the results of the last completed search over to the commands added and removed since, only scoring the
+    /// new ones. `tracked_item` is mapped to the current items too, or set to -1 if it was removed. Returns false if
+    /// there is nothing to carry over or the changes weren't all recorded, in which case nothing changed.
+    bool ApplyItemChanges(const SearchSettings& settings, int& tracked_item);
+    /// Forgets about the search in progress and the last completed one, e.g. because their results were cleared.
+    void Reset();
+    /// Also searches the items appended since the search was started, merging their matches into the results.
+    void AddItems();
+    /// Scores the next `count` candidates, and merges the matches into the results.
+    void Step(int count);
+
+private:
+    void ScoreChunk(int chunk);
+    void MergeChunks(int chunk_count);
+};
+
+/// Runs the searches of one command palette on a background thread. The latest completed results are published for
+/// the UI thread to pick up, and a search is cancelled as soon as a newer one is requested.
+class BackgroundSearchWorker
+{
+private:
+    std::thread m_Thread;
+    std::mutex m_Mutex;
+    std::condition_variable m_RequestAvailable;
+    std::condition_variable m_RequestFinished;
+
+    // Only accessed by the worker thread
+    SearchJob m_Job;
+    std::vector<SearchResult> m_Results;
+    std::vector<SearchResult> m_StagingResults;
+
+    // Protected by m_Mutex
+    char m_RequestText[std::numeric_limits<uint8_t>::max() + 1] = {};
+    SearchSettings m_RequestSettings;
+    std::atomic<int> m_RequestId{ 0 }; //< Also read by the worker thread while searching, to detect cancellation
+    int m_FinishedRequestId = 0;
+    std::vector<SearchResult> m_PublishedResults;
+    int m_PublishedRequestId = 0;
+    int m_PublishedGeneration = -1;
+    bool m_PublishedTruncated = false;
+    CommandPaletteStats m_PublishedStats;
+    int m_ConsumedRequestId = 0;
+    bool m_Stopping = false;
+
+public:
+    BackgroundSearchWorker(Instance& instance);
+    ~BackgroundSearchWorker();
+
+    /// Whether a requested search hasn't finished yet, or its results weren't picked up yet.
+    bool IsBusy();
+    /// Whether the worker thread might still be reading items for a requested search.
+    bool IsSearching();
+    /// Cancels the search in progress (if any) in favor of searching for `text`.
+    void Request(const char* text, const SearchSettings& settings);
+    /// Cancels the search in progress (if any), and waits until the worker thread stopped accessing any items.
+    void Cancel();
+    /// Swaps the newest published results into `results`, if there are any that weren't picked up yet and they are
+    /// still valid for the current set of items. Returns whether `results` changed. `latest` is set to whether they
+    /// are the results of the latest request.
+    bool ConsumeResults(std::vector<SearchResult>& results, bool& truncated, CommandPaletteStats& stats, int generation, bool& latest);
+    /// Drops the published results that weren't picked up yet, e.g. because newer ones were found elsewhere.
+    void DiscardResults();
+
+private:
+    void WorkerMain();
+};
+
+/// Everything the results of a search depend on.
+struct SearchCacheKey
+{
+    char FoldedText[std::numeric_limits<uint8_t>::max() + 1] = {};
+    FuzzySearchAlgorithm Algorithm = FuzzySearchAlgorithm_Recursive;
+    int Generation = -1; //< Context::CommandSetGeneration of the items searched
+    int ItemCount = 0;
+    int MaxResults = 0;
+
+    bool operator==(const SearchCacheKey& other) const;
+};
+
+/// The ranked results of the most recent searches of a command palette, so that going back to an earlier query (e.g.
+/// by deleting characters, or reopening the command palette with the same text) doesn't search again. Results of
+/// other sets of items are dropped as soon as they are noticed, the least recently used ones to stay within a size.
+class SearchResultCache
+{
+private:
+    struct Entry
+    {
+        SearchCacheKey Key;
+        std::vector<SearchResult> Results;
+        bool Truncated = false;
+        unsigned int LastUse = 0;
+    };
+
+    std::vector<Entry> m_Entries;
+    size_t m_Size = 0; //< Bytes taken by all entries, see GetEntrySize()
+    unsigned int m_UseCounter = 0;
+
+public:
+    /// Returns the results cached for `key`, or nullptr if there are none.
+    const std::vector<SearchResult>* Find(const SearchCacheKey& key, bool& truncated);
+    /// Caches a copy of `results`, dropping the least recently used entries so that all of them fit in `max_size` bytes.
+    void Insert(const SearchCacheKey& key, const std::vector<SearchResult>& results, bool truncated, size_t max_size);
+    void Clear();
+
+private:
+    static size_t GetEntrySize(size_t result_count);
+    void RemoveEntry(int idx);
+    void RemoveOutdatedEntries(int generation);
 };
 
 class SearchManager
 {
 private:
     Instance* m_Instance;
+    SearchJob m_Job;
+    SearchResultCache m_Cache;
+    SearchCacheKey m_CacheKey; //< Of the last requested search, its results are cached once it completes
+    BackgroundSearchWorker* m_BackgroundWorker = nullptr; //< Only present when searching in the background
+    int m_SearchGeneration = -1; //< Context::CommandSetGeneration of the items searched by the last requested search
+    int m_ResultLimit = 0; //< SearchSettings::MaxResults of the current query, grows with ShowMoreResults()
+    bool m_HoldsStorageLock = false; //< Whether commands are locked because the background worker might be reading them
+    bool m_ResultsTruncated = false; //< Whether the background search's results were truncated
+    bool m_ResetSelectionOnResults = false; //< Whether the background search's results are for a new query
+    CommandPaletteStats m_BackgroundStats; //< Of the search that produced the background search's results
 
 public:
     std::vector<SearchResult> SearchResults;
@@ -84,17 +392,230 @@ public:
 public:
     SearchManager(Instance& instance)
         : m_Instance{ &instance }
+        , m_Job(instance)
     {
     }
 
+    ~SearchManager();
+
     int GetItemCount() const;
     const char* GetItem(int idx) const;
 
     bool IsActive() const;
+    bool IsSearching() const; //< Whether SearchResults are not the results of the latest search yet
+    bool IsOutdated() const; //< Whether SearchResults were computed over a set of items that has changed since
+    bool HasMoreResults() const; //< Whether the search is done, but matches beyond the result limit were dropped
+    const CommandPaletteStats& GetStats() const; //< Only the fields about searching are set
 
     void SetSearchText(const char* text);
     void ClearSearchText();
+    /// Restarts the search for the current SearchText. The actual work is done by ContinueSearch().
     void RefreshSearchResults();
+    /// Searches again for the current SearchText, keeping twice as many results as before.
+    void ShowMoreResults();
+    /// Advances the search in progress (if any) within the context's search budget, or picks up results of the
+    /// background search.
+    void ContinueSearch();
+    /// Stops the background search (if any) from accessing items, so that they can be modified.
+    void CancelBackgroundSearch();
+    /// Unlocks commands once the background search is done with them, whether or not this command palette is still drawn.
+    void ReleaseStorageLockIfIdle();
+    /// Searches the items appended since the last search as well, without starting over.
+    void AddItems();
+    /// Updates outdated results for the commands added and removed since, instead of searching all of them again.
+    /// Returns false if they have to be refreshed instead, see SearchJob::ApplyItemChanges().
+    bool UpdateResults();
+
+private:
+    void StartSearch(bool new_query);
+    /// Drops the results and the search in progress (if any), e.g. because there is nothing to search for.
+    void DropResults();
+    /// Shows the cached results for m_CacheKey instead of searching, if there are any. Returns whether it did.
+    bool TakeCachedResults(bool new_query);
+    void CacheResults(bool truncated);
+    SearchSettings MakeSearchSettings() const;
+};
+
+/// A fixed set of threads that cooperatively run the chunks of one task at a time, together with the calling thread.
+class SearchWorkerPool
+{
+public:
+    using TaskFunc = void (*)(void* user_data, int chunk);
+
+private:
+    std::vector<std::thread> m_Threads;
+    std::mutex m_RunMutex; //< Serializes Run() calls from different threads, e.g. multiple background searches
+    std::mutex m_Mutex;
+    std::condition_variable m_WorkAvailable;
+    std::condition_variable m_WorkDone;
+    TaskFunc m_Task = nullptr;
+    void* m_TaskUserData = nullptr;
+    int m_ChunkCount = 0;
+    std::atomic<int> m_NextChunk{ 0 };
+    int m_CompletedChunks = 0;
+    int m_ActiveWorkers = 0;
+    int m_TaskId = 0;
+    bool m_Stopping = false;
+
+public:
+    SearchWorkerPool(int thread_count);
+    ~SearchWorkerPool();
+
+    int GetThreadCount() const { return static_cast<int>(m_Threads.size()) + 1; }
+
+    /// Calls `task(user_data, chunk)` for every chunk in [0, chunk_count) across all threads, returns once all of them finished.
+    void Run(int chunk_count, TaskFunc task, void* user_data);
+
+private:
+    void WorkerMain();
+    int RunChunks(TaskFunc task, void* user_data, int chunk_count);
+};
+
+/// Hash table from case-insensitive command names to command slots, using linear probing. The same name may map to
+/// multiple slots, just like multiple commands may have the same name.
+class CommandNameIndex
+{
+private:
+    struct Bucket
+    {
+        ImU32 Hash;
+        int Slot; //< kEmpty, kRemoved, or a slot in Context::Commands
+    };
+
+    static constexpr int kEmpty = -1;
+    static constexpr int kRemoved = -2; //< Still part of probe sequences, until the next rehash
+
+    std::vector<Bucket> m_Buckets;
+    int m_Count = 0;
+    int m_UsedBuckets = 0; //< Including the removed ones
+
+public:
+    static ImU32 HashName(const char* name);
+
+    void Insert(const char* name, int slot);
+    /// Returns the slot of a command named `name`, or -1 if there is none.
+    int Find(const char* name, const std::vector<Command>& commands) const;
+    /// Removes the slots of all commands named `name`, appending them to `out_slots`.
+    void RemoveAll(const char* name, const std::vector<Command>& commands, std::vector<int>& out_slots);
+
+private:
+    void Rehash(int bucket_count);
+};
+
+/// Search-relevant data of the registered commands, in the order they are presented as items (i.e. sorted by name).
+/// Kept apart from the commands' callbacks, so that searching walks a few packed arrays and one blob of names instead of
+/// chasing each Command's std::string.
+struct CommandItemStorage
+{
+    std::vector<int> Slots; //< Slot of each item's command in Context::Commands
+    std::vector<uint32_t> NameOffsets; //< Where each item's null-terminated name starts in NameArena
+    std::vector<uint64_t> Signatures; //< FuzzySearchSignature() of each item's name
+    std::vector<char> NameArena;
+    /// FuzzySearchFoldCase() of NameArena, folded once here instead of on every search. Folding keeps the length of
+    /// names, so each one is at the same offset as in NameArena.
+    std::vector<char> FoldedNameArena;
+    size_t UnusedNameBytes = 0; //< Bytes of NameArena taken by names of removed items
+
+    int GetCount() const { return static_cast<int>(Slots.size()); }
+    const char* GetName(int item) const { return NameArena.data() + NameOffsets[item]; }
+    const char* GetFoldedName(int item) const { return FoldedNameArena.data() + NameOffsets[item]; }
+
+    /// Returns the first item whose name doesn't compare less than `name`.
+    int FindInsertPosition(const char* name) const
+    {
+        int begin = 0;
+        int end = GetCount();
+        while (begin < end) {
+            int mid = begin + (end - begin) / 2;
+            if (ImStricmp(GetName(mid), name) < 0) {
+                begin = mid + 1;
+            } else {
+                end = mid;
+            }
+        }
+        return begin;
+    }
+
+    uint32_t AddName(const std::string& name)
+    {
+        auto offset = static_cast<uint32_t>(NameArena.size());
+        NameArena.insert(NameArena.end(), name.c_str(), name.c_str() + name.size() + 1);
+        FoldedNameArena.resize(NameArena.size());
+        FuzzySearchFoldCase(name.c_str(), FoldedNameArena.data() + offset);
+        return offset;
+    }
+
+    void Resize(int count)
+    {
+        Slots.resize(count);
+        NameOffsets.resize(count);
+        Signatures.resize(count);
+    }
+
+    void Set(int item, int slot, uint32_t name_offset)
+    {
+        Slots[item] = slot;
+        NameOffsets[item] = name_offset;
+        Signatures[item] = FuzzySearchSignature(GetFoldedName(item));
+    }
+
+    void Move(int dst_item, int src_item)
+    {
+        Slots[dst_item] = Slots[src_item];
+        NameOffsets[dst_item] = NameOffsets[src_item];
+        Signatures[dst_item] = Signatures[src_item];
+    }
+
+    void Insert(int item, int slot, const std::string& name)
+    {
+        auto name_offset = AddName(name);
+        Slots.insert(Slots.begin() + item, slot);
+        NameOffsets.insert(NameOffsets.begin() + item, name_offset);
+        Signatures.insert(Signatures.begin() + item, FuzzySearchSignature(GetFoldedName(item)));
+    }
+
+    /// Removes the items of the commands in `sorted_slots`, appending their indices to `out_items`.
+    void RemoveSlots(const std::vector<int>& sorted_slots, std::vector<int>& out_items)
+    {
+        int count = 0;
+        for (int i = 0; i < GetCount(); ++i) {
+            if (std::binary_search(sorted_slots.begin(), sorted_slots.end(), Slots[i])) {
+                UnusedNameBytes += std::strlen(GetName(i)) + 1;
+                out_items.push_back(i);
+            } else {
+                Move(count++, i);
+            }
+        }
+        Resize(count);
+
+        // Once most of the arena is garbage, rebuild it in item order, which is also the order searches go through it
+        if (UnusedNameBytes > NameArena.size() / 2) {
+            std::vector<char> arena;
+            std::vector<char> folded_arena;
+            arena.reserve(NameArena.size() - UnusedNameBytes);
+            folded_arena.reserve(NameArena.size() - UnusedNameBytes);
+            for (int i = 0; i < GetCount(); ++i) {
+                const char* name = GetName(i);
+                const char* folded_name = GetFoldedName(i);
+                size_t size = std::strlen(name) + 1;
+                NameOffsets[i] = static_cast<uint32_t>(arena.size());
+                arena.insert(arena.end(), name, name + size);
+                folded_arena.insert(folded_arena.end(), folded_name, folded_name + size);
+            }
+            std::swap(NameArena, arena);
+            std::swap(FoldedNameArena, folded_arena);
+            UnusedNameBytes = 0;
+        }
+    }
+};
+
+/// How CommandItems changed from one CommandSetGeneration to the next, so that search results over the old items can
+/// be carried over to the new ones instead of searching all of them again.
+struct CommandItemChange
+{
+    int Generation; //< CommandSetGeneration right after the change
+    std::vector<int> RemovedItems; //< Sorted indices of the removed items, from before the change
+    std::vector<int> InsertedItems; //< Sorted indices of the inserted items, from after the change
 };
 
 struct CommandOperationRegister
@@ -104,7 +625,7 @@ struct CommandOperationRegister
 
 struct CommandOperationUnregister
 {
-    const char* Name;
+    std::string Name;
 };
 
 struct CommandOperation
@@ -119,18 +640,67 @@ struct CommandOperation
     int Index;
 };
 
+/// A command operation submitted from any thread, see CommandOperationQueue.
+struct QueuedCommandOperation
+{
+    QueuedCommandOperation* Next = nullptr; //< The operation submitted right before this one
+    CommandOperation::OpType Type;
+    std::vector<Command> Commands; //< For OpType_Register
+    std::string Name; //< For OpType_Unregister
+};
+
+/// Lock-free multi-producer single-consumer queue of command operations. Producers push onto an intrusive stack with a
+/// compare-and-swap, and the consumer takes the whole stack at once, so there is no ABA problem to worry about.
+class CommandOperationQueue
+{
+private:
+    std::atomic<QueuedCommandOperation*> m_Head{ nullptr }; //< Newest first
+
+public:
+    CommandOperationQueue() = default;
+    CommandOperationQueue(const CommandOperationQueue&) = delete;
+    CommandOperationQueue& operator=(const CommandOperationQueue&) = delete;
+    ~CommandOperationQueue();
+
+    bool IsEmpty() const { return m_Head.load(std::memory_order_relaxed) == nullptr; }
+
+    /// Takes ownership of `op`. Can be called from any thread.
+    void Push(QueuedCommandOperation* op);
+    /// Takes all operations pushed so far, linked oldest first, or returns nullptr if there are none. The caller owns them.
+    QueuedCommandOperation* TakeAll();
+};
+
 struct Context
 {
     ImGuiStorage Instances;
     Instance* CurrentCommandPalette = nullptr;
+    /// Indexed by slot. A removed command's slot is reused once it has been compacted out of CommandItems.
     std::vector<Command> Commands;
+    CommandItemStorage CommandItems; //< The items presented by command palettes, one for each command
+    std::vector<int> FreeCommandSlots;
+    std::vector<int> RemovedCommandSlots; //< Slots that still have an item until the next CompactCommands()
+    CommandNameIndex CommandIndex;
     std::vector<CommandOperationRegister> PendingRegisterOps;
     std::vector<CommandOperationUnregister> PendingUnregisterOps;
     std::vector<CommandOperation> PendingOps;
+    CommandOperationQueue QueuedOps; //< Submitted from any thread, moved to the pending operations by CommitOps()
+    /// Bumped every time the set of items presented by any command palette changes, used to invalidate search results.
+    int CommandSetGeneration = 0;
+    /// Changes of the latest generations, oldest first. Generations without an entry (e.g. prompts pushing options)
+    /// can't be carried over, see FindItemChanges().
+    std::vector<CommandItemChange> ItemChanges;
     ImFont* TextStyleFonts[ImCmdTextType_COUNT] = {};
     ImU32 TextStyleColors[ImCmdTextType_COUNT] = {};
     ImU32 TextStyleFlags[ImCmdTextType_COUNT] = {};
     int CommandStorageLocks = 0;
+    int CommandCompactions = 0; //< Number of CompactCommands() calls that dropped items, see CommandPaletteStats
+    FuzzySearchAlgorithm SearchAlgorithm = FuzzySearchAlgorithm_Recursive;
+    SearchWorkerPool* SearchWorkers = nullptr; //< Only present when searching with more than 1 thread
+    int SearchTimeBudget = 0; //< Microseconds of searching per CommandPalette() call, 0 for unlimited
+    int SearchItemBudget = 0; //< Candidates scored per CommandPalette() call, 0 for unlimited
+    int MaxSearchResults = 0; //< Initial number of results kept per search, 0 for unlimited
+    int SearchCacheSize = 4 * 1024 * 1024; //< Bytes of recent search results kept per command palette, 0 to disable
+    bool SearchInBackground = false;
     bool TextStyleHasColorOverride[ImCmdTextType_COUNT] = {};
     bool IsExecuting = false;
     bool IsTerminating = false;
@@ -146,71 +716,237 @@ struct Context
         bool FocusSearchBox = false;
     } NextCommandPaletteActions;
 
+    ~Context();
+
+    int AllocateCommandSlot(Command command)
+    {
+        int slot;
+        if (!FreeCommandSlots.empty()) {
+            slot = FreeCommandSlots.back();
+            FreeCommandSlots.pop_back();
+        } else {
+            slot = static_cast<int>(Commands.size());
+            Commands.emplace_back();
+        }
+
+        CommandIndex.Insert(command.Name.c_str(), slot);
+        Commands[slot] = std::move(command);
+        return slot;
+    }
+
+    /// Bumps CommandSetGeneration for a change of CommandItems, returning the entry to describe it in.
+    CommandItemChange& AddItemChange()
+    {
+        // Beyond these, carrying results over isn't much cheaper than searching again anyway
+        constexpr size_t kMaxItemChanges = 32;
+        constexpr size_t kMaxItemChangeSize = 64 * 1024; //< Items inserted or removed by all entries
+
+        size_t total_size = 0;
+        for (auto& change : ItemChanges) {
+            total_size += change.RemovedItems.size() + change.InsertedItems.size();
+        }
+        size_t dropped = 0;
+        while (dropped < ItemChanges.size() && (ItemChanges.size() - dropped >= kMaxItemChanges || total_size > kMaxItemChangeSize)) {
+            total_size -= ItemChanges[dropped].RemovedItems.size() + ItemChanges[dropped].InsertedItems.size();
+            ++dropped;
+        }
+        ItemChanges.erase(ItemChanges.begin(), ItemChanges.begin() + dropped);
+
+        ++CommandSetGeneration;
+        ItemChanges.emplace_back();
+        auto& change = ItemChanges.back();
+        change.Generation = CommandSetGeneration;
+        return change;
+    }
+
+    /// Returns the index of the first of ItemChanges leading from `generation` to the current one, or -1 if some of
+    /// them weren't recorded.
+    int FindItemChanges(int generation) const
+    {
+        int count = static_cast<int>(ItemChanges.size());
+        int first = count - (CommandSetGeneration - generation);
+        if (generation > CommandSetGeneration || first < 0) {
+            return -1;
+        }
+        for (int i = first; i < count; ++i) {
+            if (ItemChanges[i].Generation != generation + 1 + (i - first)) {
+                return -1;
+            }
+        }
+        return first;
+    }
+
     void RegisterCommand(Command command)
     {
-        auto location = std::lower_bound(
-            Commands.begin(),
-            Commands.end(),
-            command,
+        CompactCommands();
+
+        int item = CommandItems.FindInsertPosition(command.Name.c_str());
+        int slot = AllocateCommandSlot(std::move(command));
+        CommandItems.Insert(item, slot, Commands[slot].Name);
+        AddItemChange().InsertedItems.push_back(item);
+    }
+
+    /// Same as calling RegisterCommand() on each of `commands` in order, but sorts them once and merges them into
+    /// CommandItems in linear time instead. `commands` is left in an unspecified state.
+    void RegisterCommands(std::vector<Command>& commands)
+    {
+        if (commands.empty()) {
+            return;
+        }
+
+        CompactCommands();
+
+        // RegisterCommand() puts a command in front of those with the same name, so among a batch the last one wins
+        std::reverse(commands.begin(), commands.end());
+        std::stable_sort(
+            commands.begin(),
+            commands.end(),
             [](const Command& a, const Command& b) -> bool {
                 return ImStricmp(a.Name.c_str(), b.Name.c_str()) < 0;
             });
-        Commands.insert(location, std::move(command));
+
+        // Store the new names in sorted order, so that they are laid out in NameArena the way they will be searched
+        std::vector<int> new_slots(commands.size());
+        std::vector<uint32_t> new_name_offsets(commands.size());
+        for (size_t i = 0; i < commands.size(); ++i) {
+            new_name_offsets[i] = CommandItems.AddName(commands[i].Name);
+            new_slots[i] = AllocateCommandSlot(std::move(commands[i]));
+        }
+
+        // Merge from the back, so that the existing items are moved at most once and without extra storage
+        auto& change = AddItemChange();
+        change.InsertedItems.resize(commands.size());
+        int src = CommandItems.GetCount();
+        int next = static_cast<int>(commands.size());
+        int dst = src + next;
+        CommandItems.Resize(dst);
+        while (next > 0) {
+            --dst;
+            // Ties go to the existing item, so that it ends up behind the new ones
+            const char* new_name = CommandItems.NameArena.data() + new_name_offsets[next - 1];
+            if (src > 0 && ImStricmp(CommandItems.GetName(src - 1), new_name) >= 0) {
+                --src;
+                CommandItems.Move(dst, src);
+            } else {
+                --next;
+                CommandItems.Set(dst, new_slots[next], new_name_offsets[next]);
+                change.InsertedItems[next] = dst;
+            }
+        }
     }
 
     bool UnregisterCommand(const char* name)
     {
-        struct Comparator
-        {
-            bool operator()(const Command& command, const char* str) const
-            {
-                return ImStricmp(command.Name.c_str(), str) < 0;
-            }
+        // Only look the commands up and leave their items around for now, so that removing many commands only shifts
+        // CommandItems once
+        size_t first_removed = RemovedCommandSlots.size();
+        CommandIndex.RemoveAll(name, Commands, RemovedCommandSlots);
+        if (RemovedCommandSlots.size() == first_removed) {
+            return false;
+        }
 
-            bool operator()(const char* str, const Command& command) const
-            {
-                return ImStricmp(str, command.Name.c_str()) < 0;
-            }
-        };
+        for (size_t i = first_removed; i < RemovedCommandSlots.size(); ++i) {
+            // Release the name and callbacks right away
+            Commands[RemovedCommandSlots[i]] = Command{};
+        }
+        // The items stay where they are until CompactCommands(), which records all the removals as a single change.
+        // CommandPalette() compacts before searching or drawing, so nothing gets to see the leftover items.
+
+        return true;
+    }
 
-        auto range = std::equal_range(Commands.begin(), Commands.end(), name, Comparator{});
-        Commands.erase(range.first, range.second);
+    /// Drops the items of removed commands, so that their slots can be reused.
+    void CompactCommands()
+    {
+        if (RemovedCommandSlots.empty()) {
+            return;
+        }
 
-        return range.first != range.second;
+        ++CommandCompactions;
+        std::sort(RemovedCommandSlots.begin(), RemovedCommandSlots.end());
+        // Item indices have shifted
+        CommandItems.RemoveSlots(RemovedCommandSlots, AddItemChange().RemovedItems);
+        FreeCommandSlots.insert(FreeCommandSlots.end(), RemovedCommandSlots.begin(), RemovedCommandSlots.end());
+        RemovedCommandSlots.clear();
     }
 
-    bool CommitOps()
+    /// Applies the pending command operations, unless commands are locked. Removed commands keep their items until the
+    /// next CompactCommands().
+    void ApplyPendingOps()
     {
         if (IsCommandStorageLocked()) {
-            return false;
+            return;
+        }
+
+        // Operations from other threads go after the ones from this thread, as if they were submitted just now
+        auto queued = QueuedOps.TakeAll();
+        while (queued) {
+            if (queued->Type == CommandOperation::OpType_Register) {
+                for (auto& command : queued->Commands) {
+                    AddPendingOp(CommandOperation::OpType_Register, PendingRegisterOps, CommandOperationRegister{ std::move(command) });
+                }
+            } else {
+                AddPendingOp(CommandOperation::OpType_Unregister, PendingUnregisterOps, CommandOperationUnregister{ std::move(queued->Name) });
+            }
+            auto next = queued->Next;
+            delete queued;
+            queued = next;
         }
 
+        // Consecutive registrations are merged in all at once, they only need to be flushed before an unregistration
+        // that might refer to them
+        std::vector<Command> batch;
         for (auto& operation : PendingOps) {
             switch (operation.Type) {
                 case CommandOperation::OpType_Register: {
                     auto& op = PendingRegisterOps[operation.Index];
-                    RegisterCommand(std::move(op.Candidate));
+                    batch.push_back(std::move(op.Candidate));
                 } break;
 
                 case CommandOperation::OpType_Unregister: {
                     auto& op = PendingUnregisterOps[operation.Index];
-                    UnregisterCommand(op.Name);
+                    RegisterCommands(batch);
+                    batch.clear();
+                    UnregisterCommand(op.Name.c_str());
                 } break;
             }
         }
+        RegisterCommands(batch);
 
-        bool had_action = !PendingOps.empty();
         PendingRegisterOps.clear();
         PendingUnregisterOps.clear();
         PendingOps.clear();
+    }
+
+    void CommitOps()
+    {
+        if (IsCommandStorageLocked()) {
+            return;
+        }
 
-        return had_action;
+        ApplyPendingOps();
+        CompactCommands();
     }
 
     bool IsCommandStorageLocked() const
     {
         return CommandStorageLocks > 0;
     }
+
+    /// Applies the pending command operations if nothing locks commands anymore. Background searches of command
+    /// palettes that aren't drawn anymore give up their locks here, instead of holding them until the next CommandPalette().
+    /// Unlike CommitOps(), removed commands aren't compacted, so that calling this before every operation stays cheap.
+    void FlushPendingOps();
+
+    template <class TOp>
+    void AddPendingOp(CommandOperation::OpType type, std::vector<TOp>& ops, TOp op)
+    {
+        ops.push_back(std::move(op));
+        CommandOperation operation;
+        operation.Type = type;
+        operation.Index = static_cast<int>(ops.size()) - 1;
+        PendingOps.push_back(operation);
+    }
 };
 
 struct ItemExtraData
@@ -219,11 +955,67 @@ struct ItemExtraData
     bool Held = false;
 };
 
+/// A run of characters in a search result row that are all either highlighted or not.
+struct RowSegment
+{
+    int Begin;
+    int End;
+    float Width;
+    float Height; //< Underlines are drawn at this offset from the top of the row
+    bool Highlighted;
+};
+
+struct RowLayout
+{
+    const RowSegment* Segments;
+    int SegmentCount;
+    int TailBegin; //< Start of the text after the last highlighted segment, which is drawn as-is
+};
+
+/// Segments of recently drawn search result rows along with their measured sizes, so that steady frames don't have to
+/// split and measure the text again. Rows are looked up by item and validated against their matches, which covers the
+/// results being re-sorted, extended, or replaced by those of another query.
+class RowLayoutCache
+{
+private:
+    struct Row
+    {
+        int MatchCount;
+        uint16_t Matches[32];
+        int FirstSegment;
+        int SegmentCount;
+        int SegmentCapacity; //< Segments reserved at FirstSegment, reused when the row is laid out again
+        int TailBegin;
+    };
+
+    ImGuiStorage m_RowLookup; //< Item index -> index into m_Rows + 1
+    std::vector<Row> m_Rows;
+    std::vector<RowSegment> m_Segments;
+
+    // What the cached rows were laid out with
+    ImFont* m_FontRegular = nullptr;
+    ImFont* m_FontHighlight = nullptr;
+    float m_FontSizeRegular = 0.0f;
+    float m_FontSizeHighlight = 0.0f;
+    int m_Generation = -1;
+
+public:
+    /// Drops every cached row if they were measured with different fonts, or refer to a different set of items.
+    void Validate(ImFont* font_regular, float font_size_regular, ImFont* font_highlight, float font_size_highlight, int generation);
+    /// Returns the layout of the row of `result`, laying it out if necessary. Only valid until the next call.
+    RowLayout GetLayout(const SearchResult& result, const char* text);
+    void Clear();
+};
+
 struct Instance
 {
+    Context* Owner;
     ExecutionManager Session;
     SearchManager Search;
-    std::vector<ItemExtraData> ExtraData;
+    std::vector<ItemExtraData> ExtraData; //< State of the rows [ExtraDataBegin, ExtraDataBegin + ExtraData.size()), i.e. the visible ones
+    int ExtraDataBegin = 0;
+    RowLayoutCache RowLayouts;
+    CommandPaletteStats Stats; //< Only the fields about the latest CommandPalette() call are set, see SearchManager::GetStats()
 
     int CurrentSelectedItem = 0;
 
@@ -233,155 +1025,1488 @@ struct Instance
         bool ClearSearch = false;
     } PendingActions;
 
-    Instance()
-        : Session(*this)
+    Instance(Context& owner)
+        : Owner{ &owner }
+        , Session(*this)
         , Search(*this) {}
+
+    /// Returns the state of the row at `item`, growing ExtraData to cover it if necessary.
+    ItemExtraData& GetExtraData(int item)
+    {
+        if (ExtraData.empty()) {
+            ExtraDataBegin = item;
+        }
+        if (item < ExtraDataBegin) {
+            ExtraData.insert(ExtraData.begin(), ExtraDataBegin - item, ItemExtraData{});
+            ExtraDataBegin = item;
+        } else if (item >= ExtraDataBegin + static_cast<int>(ExtraData.size())) {
+            ExtraData.resize(item - ExtraDataBegin + 1);
+        }
+        return ExtraData[item - ExtraDataBegin];
+    }
+
+    /// Drops the state of the rows outside of [begin, end).
+    void TrimExtraData(int begin, int end)
+    {
+        int old_end = ExtraDataBegin + static_cast<int>(ExtraData.size());
+        begin = ImClamp(begin, ExtraDataBegin, old_end);
+        end = ImClamp(end, begin, old_end);
+        ExtraData.erase(ExtraData.begin() + (end - ExtraDataBegin), ExtraData.end());
+        ExtraData.erase(ExtraData.begin(), ExtraData.begin() + (begin - ExtraDataBegin));
+        ExtraDataBegin = begin;
+    }
 };
 
 static Context* gContext = nullptr;
 
+CommandOperationQueue::~CommandOperationQueue()
+{
+    auto op = m_Head.load(std::memory_order_acquire);
+    while (op) {
+        auto next = op->Next;
+        delete op;
+        op = next;
+    }
+}
+
+void CommandOperationQueue::Push(QueuedCommandOperation* op)
+{
+    op->Next = m_Head.load(std::memory_order_relaxed);
+    // Publishes the operation's contents along with it, on failure op->Next is updated to the current head
+    while (!m_Head.compare_exchange_weak(op->Next, op, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+QueuedCommandOperation* CommandOperationQueue::TakeAll()
+{
+    auto op = m_Head.exchange(nullptr, std::memory_order_acquire);
+
+    // Reverse into submission order
+    QueuedCommandOperation* oldest = nullptr;
+    while (op) {
+        auto next = op->Next;
+        op->Next = oldest;
+        oldest = op;
+        op = next;
+    }
+    return oldest;
+}
+
+void Context::FlushPendingOps()
+{
+    for (auto& entry : Instances.Data) {
+        if (auto instance = reinterpret_cast<Instance*>(entry.val_p)) {
+            instance->Search.ReleaseStorageLockIfIdle();
+        }
+    }
+    // Also keeps newer operations from being applied before the pending ones
+    ApplyPendingOps();
+}
+
+Context::~Context()
+{
+    // Instances might be searching in the background with the worker pool, stop them first
+    for (auto& entry : Instances.Data) {
+        delete reinterpret_cast<Instance*>(entry.val_p);
+    }
+    delete SearchWorkers;
+}
+
 // =================================================================
 // Private implementation
 // =================================================================
 
+ExecutionManager::~ExecutionManager()
+{
+    ClearCallStack();
+}
+
 int ExecutionManager::GetItemCount() const
 {
     if (m_ExecutingCommand) {
-        return static_cast<int>(m_CallStack.back().Options.size());
+        auto& frame = m_CallStack.back();
+        return frame.Getter ? frame.GetterOptionCount : static_cast<int>(frame.Options.size());
     } else {
-        return static_cast<int>(gContext->Commands.size());
+        return m_Instance->Owner->CommandItems.GetCount();
     }
 }
 
 const char* ExecutionManager::GetItem(int idx) const
 {
     if (m_ExecutingCommand) {
-        return m_CallStack.back().Options[idx].c_str();
+        auto& frame = m_CallStack.back();
+        return frame.Getter ? frame.Getter(frame.GetterUserData, idx) : frame.Options[idx].c_str();
     } else {
-        return gContext->Commands[idx].Name.c_str();
+        return m_Instance->Owner->CommandItems.GetName(idx);
     }
 }
 
-template <class TFunc, class... Ts>
-static void InvokeSafe(const TFunc& func, Ts&&... args)
+const char* ExecutionManager::GetFoldedItem(int idx) const
 {
-    if (func) {
-        func(std::forward<Ts>(args)...);
-    }
+    if (m_ExecutingCommand) {
+        auto& frame = m_CallStack.back();
+        return frame.Getter ? nullptr : frame.GetFoldedOption(idx);
+    } else {
+        return m_Instance->Owner->CommandItems.GetFoldedName(idx);
+    }
+}
+
+uint64_t ExecutionManager::GetItemSignature(int idx) const
+{
+    if (m_ExecutingCommand) {
+        auto& frame = m_CallStack.back();
+        // Computing signatures would mean going through every option up front, so don't prefilter option sources
+        return frame.Getter ? ~static_cast<uint64_t>(0) : frame.OptionSignatures[idx];
+    } else {
+        return m_Instance->Owner->CommandItems.Signatures[idx];
+    }
+}
+
+template <class TFunc, class... Ts>
+static void InvokeSafe(const TFunc& func, Ts&&... args)
+{
+    if (func) {
+        func(std::forward<Ts>(args)...);
+    }
+}
+
+template <class TFuncPtr, class TFunc, class... Ts>
+static void InvokeCallback(TFuncPtr func_ptr, void* user_data, const TFunc& func, Ts&&... args)
+{
+    if (func_ptr) {
+        func_ptr(user_data, std::forward<Ts>(args)...);
+    } else {
+        InvokeSafe(func, std::forward<Ts>(args)...);
+    }
 }
 
 void ExecutionManager::SelectItem(int idx)
 {
+    // Commands' callbacks might modify the items being searched
+    m_Instance->Search.CancelBackgroundSearch();
+
     auto cmd = m_ExecutingCommand;
     size_t initial_call_stack_height = m_CallStack.size();
 
     // Guarding aginst invalid index.
-    if (idx >= gContext->Commands.size()) return;
-    IM_ASSERT(idx < gContext->Commands.size());
+    if (idx < 0 || idx >= GetItemCount()) return;
+    IM_ASSERT(idx < GetItemCount());
 
     if (cmd == nullptr) {
-        cmd = m_ExecutingCommand = &gContext->Commands[idx];
+        cmd = m_ExecutingCommand = &gContext->Commands[gContext->CommandItems.Slots[idx]];
         ++gContext->CommandStorageLocks;
 
         gContext->IsExecuting = true;
-        InvokeSafe(m_ExecutingCommand->InitialCallback); // Calls ::Prompt()
+        InvokeCallback(cmd->InitialCallbackFn, cmd->UserData, cmd->InitialCallback); // Calls ::Prompt()
         gContext->IsExecuting = false;
     } else {
         m_CallStack.back().SelectedOption = idx;
 
         gContext->IsExecuting = true;
-        InvokeSafe(cmd->SubsequentCallback, idx); // Calls ::Prompt()
+        InvokeCallback(cmd->SubsequentCallbackFn, cmd->UserData, cmd->SubsequentCallback, idx); // Calls ::Prompt()
         gContext->IsExecuting = false;
     }
 
     size_t final_call_stack_height = m_CallStack.size();
     if (initial_call_stack_height == final_call_stack_height) {
 
-        gContext->IsTerminating = true;
-        InvokeSafe(m_ExecutingCommand->TerminatingCallback); // Shouldn't call ::Prompt()
-        gContext->IsTerminating = false;
+        gContext->IsTerminating = true;
+        InvokeCallback(cmd->TerminatingCallbackFn, cmd->UserData, cmd->TerminatingCallback); // Shouldn't call ::Prompt()
+        gContext->IsTerminating = false;
+
+        m_ExecutingCommand = nullptr;
+        ClearCallStack();
+        --gContext->CommandStorageLocks;
+
+        // If the executed command involved subcommands...
+        if (final_call_stack_height > 0) {
+            ++gContext->CommandSetGeneration;
+            m_Instance->PendingActions.ClearSearch = true;
+            m_Instance->CurrentSelectedItem = 0;
+        }
+
+        gContext->LastCommandPaletteStatus.ItemSelected = true;
+    } else {
+        // Something new is prompted
+        // It doesn't make sense for "current selected item" to persists through completely different set of options
+        m_Instance->PendingActions.ClearSearch = true;
+        m_Instance->CurrentSelectedItem = 0;
+    }
+}
+
+void ExecutionManager::PushOptions(std::vector<std::string> options)
+{
+    m_CallStack.push_back({});
+    auto& frame = m_CallStack.back();
+
+    frame.Options = std::move(options);
+    frame.OptionSignatures.reserve(frame.Options.size());
+    frame.FoldedOptionOffsets.reserve(frame.Options.size());
+    for (auto& option : frame.Options) {
+        frame.AddOptionSearchData(option);
+    }
+    ++gContext->CommandSetGeneration;
+
+    m_Instance->PendingActions.ClearSearch = true;
+}
+
+void ExecutionManager::PushOptions(int count, OptionGetter getter, void* user_data)
+{
+    m_CallStack.push_back({});
+    auto& frame = m_CallStack.back();
+
+    frame.Getter = getter;
+    frame.GetterUserData = user_data;
+    frame.GetterOptionCount = count;
+    ++gContext->CommandSetGeneration;
+
+    m_Instance->PendingActions.ClearSearch = true;
+}
+
+OptionStream* ExecutionManager::PushOptionStream()
+{
+    m_CallStack.push_back({});
+    auto& frame = m_CallStack.back();
+
+    frame.Stream = new OptionStream();
+    ++gContext->CommandSetGeneration;
+
+    m_Instance->PendingActions.ClearSearch = true;
+    return frame.Stream;
+}
+
+void ExecutionManager::ReceiveOptions()
+{
+    if (!m_ExecutingCommand || !m_CallStack.back().Stream) {
+        return;
+    }
+
+    auto& frame = m_CallStack.back();
+    {
+        std::lock_guard<std::mutex> lock(frame.Stream->Mutex);
+        if (frame.Stream->PendingOptions.empty()) {
+            return;
+        }
+        std::swap(m_ReceivedOptions, frame.Stream->PendingOptions);
+    }
+
+    // The background search might be reading the options
+    m_Instance->Search.CancelBackgroundSearch();
+
+    // Appending items keeps the existing ones' indices, so CommandSetGeneration stays the same and searches can carry on
+    frame.Options.reserve(frame.Options.size() + m_ReceivedOptions.size());
+    frame.OptionSignatures.reserve(frame.Options.size() + m_ReceivedOptions.size());
+    frame.FoldedOptionOffsets.reserve(frame.Options.size() + m_ReceivedOptions.size());
+    for (auto& option : m_ReceivedOptions) {
+        frame.AddOptionSearchData(option);
+        frame.Options.push_back(std::move(option));
+    }
+    m_ReceivedOptions.clear();
+
+    m_Instance->Search.AddItems();
+}
+
+bool ExecutionManager::IsReceivingOptions() const
+{
+    return m_ExecutingCommand && m_CallStack.back().Stream && !m_CallStack.back().Stream->Finished;
+}
+
+void ExecutionManager::ClearCallStack()
+{
+    for (auto& frame : m_CallStack) {
+        if (frame.Stream) {
+            frame.Stream->Closed = true;
+            ReleaseOptionStream(frame.Stream);
+        }
+    }
+    m_CallStack.clear();
+}
+
+int SearchManager::GetItemCount() const
+{
+    return static_cast<int>(SearchResults.size());
+}
+
+const char* SearchManager::GetItem(int idx) const
+{
+    int actualIdx = SearchResults[idx].ItemIndex;
+    return m_Instance->Session.GetItem(actualIdx);
+}
+
+bool SearchManager::IsActive() const
+{
+    return SearchText[0] != '\0';
+}
+
+bool SearchCacheKey::operator==(const SearchCacheKey& other) const
+{
+    return Algorithm == other.Algorithm &&
+        Generation == other.Generation &&
+        ItemCount == other.ItemCount &&
+        MaxResults == other.MaxResults &&
+        std::strcmp(FoldedText, other.FoldedText) == 0;
+}
+
+const std::vector<SearchResult>* SearchResultCache::Find(const SearchCacheKey& key, bool& truncated)
+{
+    RemoveOutdatedEntries(key.Generation);
+    for (auto& entry : m_Entries) {
+        if (entry.Key == key) {
+            entry.LastUse = ++m_UseCounter;
+            truncated = entry.Truncated;
+            return &entry.Results;
+        }
+    }
+    return nullptr;
+}
+
+void SearchResultCache::Insert(const SearchCacheKey& key, const std::vector<SearchResult>& results, bool truncated, size_t max_size)
+{
+    // Few enough that finding entries by scanning all of them is cheap compared to any search
+    constexpr int kMaxEntries = 64;
+
+    RemoveOutdatedEntries(key.Generation);
+    for (int i = 0; i < static_cast<int>(m_Entries.size()); ++i) {
+        if (m_Entries[i].Key == key) {
+            RemoveEntry(i);
+            break;
+        }
+    }
+
+    size_t entry_size = GetEntrySize(results.size());
+    if (entry_size > max_size) {
+        // Not worth evicting everything else for, e.g. the results of a single character query over lots of commands
+        return;
+    }
+    while (!m_Entries.empty() && (m_Size + entry_size > max_size || static_cast<int>(m_Entries.size()) >= kMaxEntries)) {
+        int lru = 0;
+        for (int i = 1; i < static_cast<int>(m_Entries.size()); ++i) {
+            if (m_Entries[i].LastUse < m_Entries[lru].LastUse) {
+                lru = i;
+            }
+        }
+        RemoveEntry(lru);
+    }
+
+    // Entries are moved around when others are removed, never reallocate them on top of that
+    m_Entries.reserve(kMaxEntries);
+    m_Entries.emplace_back();
+    auto& entry = m_Entries.back();
+    entry.Key = key;
+    entry.Results = results;
+    entry.Truncated = truncated;
+    entry.LastUse = ++m_UseCounter;
+    m_Size += entry_size;
+}
+
+void SearchResultCache::Clear()
+{
+    m_Entries.clear();
+    m_Size = 0;
+}
+
+size_t SearchResultCache::GetEntrySize(size_t result_count)
+{
+    return sizeof(Entry) + result_count * sizeof(SearchResult);
+}
+
+void SearchResultCache::RemoveEntry(int idx)
+{
+    m_Size -= GetEntrySize(m_Entries[idx].Results.size());
+    // Order doesn't matter, recency is tracked by Entry::LastUse
+    std::swap(m_Entries[idx], m_Entries.back());
+    m_Entries.pop_back();
+}
+
+void SearchResultCache::RemoveOutdatedEntries(int generation)
+{
+    for (int i = static_cast<int>(m_Entries.size()) - 1; i >= 0; --i) {
+        if (m_Entries[i].Key.Generation != generation) {
+            RemoveEntry(i);
+        }
+    }
+}
+
+SearchManager::~SearchManager()
+{
+    CancelBackgroundSearch();
+    delete m_BackgroundWorker;
+}
+
+bool SearchManager::IsSearching() const
+{
+    if (m_BackgroundWorker) {
+        return m_BackgroundWorker->IsBusy();
+    }
+    return m_Job.IsSearching();
+}
+
+const CommandPaletteStats& SearchManager::GetStats() const
+{
+    return m_BackgroundWorker ? m_BackgroundStats : m_Job.GetStats();
+}
+
+bool SearchManager::IsOutdated() const
+{
+    return IsActive() && m_SearchGeneration != m_Instance->Owner->CommandSetGeneration;
+}
+
+bool SearchManager::HasMoreResults() const
+{
+    if (m_BackgroundWorker) {
+        return m_ResultsTruncated && !m_BackgroundWorker->IsBusy();
+    }
+    return m_Job.IsTruncated() && !m_Job.IsSearching();
+}
+
+void SearchManager::SetSearchText(const char* text)
+{
+    // Copy at most IM_ARRAYSIZE(SearchText) chars from `text` to `SearchText`
+    ImStrncpy(SearchText, text, IM_ARRAYSIZE(SearchText));
+    RefreshSearchResults();
+}
+
+void SearchManager::ClearSearchText()
+{
+    // ImGui doesn't have a ImMemset either, they use std::memset too
+    std::memset(SearchText, 0, IM_ARRAYSIZE(SearchText));
+    DropResults();
+}
+
+void SearchManager::RefreshSearchResults()
+{
+    // A new query starts over with the configured number of results
+    m_ResultLimit = m_Instance->Owner->MaxSearchResults;
+    StartSearch(true);
+}
+
+void SearchManager::ShowMoreResults()
+{
+    if (m_ResultLimit > 0) {
+        m_ResultLimit = m_ResultLimit <= std::numeric_limits<int>::max() / 2 ? m_ResultLimit * 2 : 0;
+    }
+    StartSearch(false);
+}
+
+void SearchManager::StartSearch(bool new_query)
+{
+    // An empty query lists every item in order, see CommandPalette(). Scanning them all would only keep showing
+    // "Searching..." for a while when there is a search budget.
+    if (!IsActive()) {
+        if (new_query) {
+            m_Instance->CurrentSelectedItem = 0;
+        }
+        DropResults();
+        return;
+    }
+
+    auto& gg = *m_Instance->Owner;
+    auto settings = MakeSearchSettings();
+    m_SearchGeneration = settings.Generation;
+
+    FuzzySearchFoldCase(SearchText, m_CacheKey.FoldedText);
+    m_CacheKey.Algorithm = settings.Algorithm;
+    m_CacheKey.Generation = settings.Generation;
+    m_CacheKey.ItemCount = m_Instance->Session.GetItemCount();
+    m_CacheKey.MaxResults = settings.MaxResults;
+    if (TakeCachedResults(new_query)) {
+        return;
+    }
+
+    if (gg.SearchInBackground) {
+        if (!m_BackgroundWorker) {
+            // The synchronous search's state doesn't carry over
+            m_Job.Reset();
+            m_BackgroundWorker = new BackgroundSearchWorker(*m_Instance);
+        }
+
+        // Keep commands from being modified while they are being searched, see ContinueSearch()
+        if (!m_HoldsStorageLock) {
+            ++gg.CommandStorageLocks;
+            m_HoldsStorageLock = true;
+        }
+
+        // Keep showing current results (and selection) until the new ones are ready
+        m_ResetSelectionOnResults |= new_query;
+        m_BackgroundWorker->Request(SearchText, settings);
+    } else {
+        if (new_query) {
+            m_Instance->CurrentSelectedItem = 0;
+        }
+        m_Job.Restart(SearchText, settings, SearchResults);
+    }
+}
+
+bool SearchManager::TakeCachedResults(bool new_query)
+{
+    auto& gg = *m_Instance->Owner;
+    if (gg.SearchCacheSize <= 0) {
+        m_Cache.Clear();
+        return false;
+    }
+
+    bool truncated = false;
+    auto results = m_Cache.Find(m_CacheKey, truncated);
+    if (!results) {
+        return false;
+    }
+
+    if (new_query) {
+        m_Instance->CurrentSelectedItem = 0;
+    }
+    SearchResults = *results;
+    CommandPaletteStats stats;
+    IMCMD_STATS(stats.ResultsFromCache = true);
+    if (m_BackgroundWorker) {
+        // Results of the search in progress (or of an older one) would replace these once picked up
+        CancelBackgroundSearch();
+        m_BackgroundWorker->DiscardResults();
+        m_ResultsTruncated = truncated;
+        m_ResetSelectionOnResults = false;
+        m_BackgroundStats = stats;
+    } else {
+        m_Job.Assign(SearchText, MakeSearchSettings(), SearchResults, truncated, stats);
+    }
+    return true;
+}
+
+void SearchManager::DropResults()
+{
+    CancelBackgroundSearch();
+    if (m_BackgroundWorker) {
+        // Otherwise results of the cancelled search could still be picked up by ContinueSearch()
+        m_BackgroundWorker->DiscardResults();
+        m_ResetSelectionOnResults = false;
+    }
+    SearchResults.clear();
+    m_Job.Reset();
+}
+
+void SearchManager::CacheResults(bool truncated)
+{
+    auto& gg = *m_Instance->Owner;
+    if (gg.SearchCacheSize > 0) {
+        m_Cache.Insert(m_CacheKey, SearchResults, truncated, static_cast<size_t>(gg.SearchCacheSize));
+    }
+}
+
+void SearchManager::ContinueSearch()
+{
+    auto& gg = *m_Instance->Owner;
+
+    if (m_BackgroundWorker) {
+        if (!gg.SearchInBackground) {
+            // Switched back to searching on the UI thread
+            CancelBackgroundSearch();
+            delete m_BackgroundWorker;
+            m_BackgroundWorker = nullptr;
+            if (IsActive()) {
+                RefreshSearchResults();
+            }
+        } else {
+            // New results are only swapped in here, i.e. before the items are drawn, so the selection always refers to them
+            bool latest = false;
+            if (m_BackgroundWorker->ConsumeResults(SearchResults, m_ResultsTruncated, m_BackgroundStats, gg.CommandSetGeneration, latest)) {
+                // More results for the same query extend the list, so the selection still makes sense
+                if (m_ResetSelectionOnResults) {
+                    m_Instance->CurrentSelectedItem = 0;
+                    m_ResetSelectionOnResults = false;
+                }
+                if (latest) {
+                    CacheResults(m_ResultsTruncated);
+                }
+            }
+            ReleaseStorageLockIfIdle();
+            return;
+        }
+    }
+
+    if (!m_Job.IsSearching()) {
+        return;
+    }
+
+    int time_budget = gg.SearchTimeBudget;
+    int item_budget = gg.SearchItemBudget;
+    if (time_budget <= 0 && item_budget <= 0) {
+        m_Job.Step(std::numeric_limits<int>::max());
+    } else {
+        auto start_time = std::chrono::steady_clock::now();
+        int remaining_items = item_budget > 0 ? item_budget : std::numeric_limits<int>::max();
+        while (m_Job.IsSearching() && remaining_items > 0) {
+            // Without a time budget, the whole item budget can be done in one step
+            int step_size = time_budget > 0 ? ImMin(m_Job.GetStepSize(), remaining_items) : remaining_items;
+            m_Job.Step(step_size);
+            remaining_items -= step_size;
+
+            auto elapsed = std::chrono::steady_clock::now() - start_time;
+            if (time_budget > 0 && std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() >= time_budget) {
+                break;
+            }
+        }
+    }
+
+    if (!m_Job.IsSearching()) {
+        CacheResults(m_Job.IsTruncated());
+    }
+}
+
+void SearchManager::CancelBackgroundSearch()
+{
+    if (!m_BackgroundWorker) {
+        return;
+    }
+
+    m_BackgroundWorker->Cancel();
+    if (m_HoldsStorageLock) {
+        --m_Instance->Owner->CommandStorageLocks;
+        m_HoldsStorageLock = false;
+    }
+}
+
+void SearchManager::ReleaseStorageLockIfIdle()
+{
+    if (m_HoldsStorageLock && !m_BackgroundWorker->IsSearching()) {
+        --m_Instance->Owner->CommandStorageLocks;
+        m_HoldsStorageLock = false;
+    }
+}
+
+void SearchManager::AddItems()
+{
+    // An outdated search gets refreshed anyway, which covers the new items too
+    if (!IsActive() || IsOutdated()) {
+        return;
+    }
+
+    if (m_BackgroundWorker) {
+        // The worker narrows the last results down to the new items itself, since the query is the same
+        StartSearch(false);
+    } else {
+        m_Job.AddItems();
+        m_CacheKey.ItemCount = m_Instance->Session.GetItemCount();
+    }
+}
+
+bool SearchManager::UpdateResults()
+{
+    // The background worker narrows its own copy of the results down, it searches again instead
+    if (m_BackgroundWorker) {
+        return false;
+    }
+
+    int& selection = m_Instance->CurrentSelectedItem;
+    int selected_item = selection >= 0 && selection < static_cast<int>(SearchResults.size()) ? SearchResults[selection].ItemIndex : -1;
+    auto settings = MakeSearchSettings();
+    if (!m_Job.ApplyItemChanges(settings, selected_item)) {
+        return false;
+    }
+    m_SearchGeneration = settings.Generation;
+
+    // Keep the same command selected, or the row in its place if it was removed
+    if (selected_item != -1) {
+        for (int i = 0; i < static_cast<int>(SearchResults.size()); ++i) {
+            if (SearchResults[i].ItemIndex == selected_item) {
+                selection = i;
+                break;
+            }
+        }
+    }
+    selection = ImClamp(selection, 0, ImMax(static_cast<int>(SearchResults.size()) - 1, 0));
+
+    m_CacheKey.Generation = settings.Generation;
+    m_CacheKey.ItemCount = m_Instance->Session.GetItemCount();
+    CacheResults(m_Job.IsTruncated());
+    return true;
+}
+
+SearchSettings SearchManager::MakeSearchSettings() const
+{
+    auto& gg = *m_Instance->Owner;
+    SearchSettings settings;
+    settings.Algorithm = gg.SearchAlgorithm;
+    settings.Workers = gg.SearchWorkers;
+    settings.Generation = gg.CommandSetGeneration;
+    settings.MaxResults = m_ResultLimit;
+    return settings;
+}
+
+int SearchJob::GetStepSize() const
+{
+    // Small enough to check for time budget or cancellation often, while still giving each thread a few chunks
+    constexpr int kStepSizePerThread = 1024;
+    return kStepSizePerThread * (m_Settings.Workers ? m_Settings.Workers->GetThreadCount() : 1);
+}
+
+void SearchJob::Restart(const char* text, const SearchSettings& settings, std::vector<SearchResult>& results)
+{
+    ImStrncpy(m_SearchText, text, IM_ARRAYSIZE(m_SearchText));
+    FuzzySearchFoldCase(m_SearchText, m_FoldedSearchText);
+
+    // Every item matching the new query must also match any prefix of it, so if the new query only appended characters
+    // to the one that produced the last complete results (over the same set of items), we only need to rescore those.
+    // This also holds if the user keeps typing while narrowing down is still in progress.
+    // Otherwise (characters deleted or edited in the middle, commands added/removed, etc.), fall back to a full scan.
+    // Truncated results are no good either, the dropped matches might rank higher for the new query.
+    size_t last_search_text_len = std::strlen(m_LastSearchText);
+    bool has_last_results = m_Searching ? m_Narrowing : !m_Truncated;
+    bool can_narrow = has_last_results &&
+        last_search_text_len > 0 &&
+        m_LastSearchGeneration == settings.Generation &&
+        std::strncmp(m_FoldedSearchText, m_LastSearchText, last_search_text_len) == 0;
+
+    int item_count = m_Instance->Session.GetItemCount();
+    if (can_narrow) {
+        int covered_item_count = m_ItemCount;
+        if (!m_Searching) {
+            std::swap(m_Candidates, results);
+            covered_item_count = m_LastSearchItemCount;
+        }
+        // Items appended since haven't been ruled out by the previous query
+        m_Candidates.reserve(m_Candidates.size() + (item_count - covered_item_count));
+        for (int i = covered_item_count; i < item_count; ++i) {
+            SearchResult candidate = {};
+            candidate.ItemIndex = i;
+            m_Candidates.push_back(candidate);
+        }
+        m_CandidateCount = static_cast<int>(m_Candidates.size());
+    } else {
+        m_LastSearchText[0] = '\0';
+        m_CandidateCount = item_count;
+    }
+    m_ItemCount = item_count;
+
+    // Cheap rejection of items that lack some character in the query altogether, before running the fuzzy matcher
+    m_SearchSignature = FuzzySearchSignature(m_FoldedSearchText);
+    m_Settings = settings;
+    m_Results = &results;
+    m_NextCandidate = 0;
+    m_Narrowing = can_narrow;
+    m_Searching = true;
+    m_Truncated = false;
+    IMCMD_STATS(m_Stats = {});
+    results.clear();
+}
+
+void SearchJob::Assign(const char* text, const SearchSettings& settings, std::vector<SearchResult>& results, bool truncated, const CommandPaletteStats& stats)
+{
+    ImStrncpy(m_SearchText, text, IM_ARRAYSIZE(m_SearchText));
+    FuzzySearchFoldCase(m_SearchText, m_FoldedSearchText);
+    ImStrncpy(m_LastSearchText, m_FoldedSearchText, IM_ARRAYSIZE(m_LastSearchText));
+    m_LastSearchGeneration = settings.Generation;
+    m_LastSearchItemCount = m_Instance->Session.GetItemCount();
+    m_ItemCount = m_LastSearchItemCount;
+
+    m_Settings = settings;
+    m_Results = &results;
+    m_Narrowing = false;
+    m_Searching = false;
+    m_Truncated = truncated;
+    m_Stats = stats;
+}
+
+/// Maps `item` from before `change` to after it. Returns -1 if it was removed.
+static int RemapItem(int item, const CommandItemChange& change)
+{
+    auto& removed = change.RemovedItems;
+    auto removed_it = std::lower_bound(removed.begin(), removed.end(), item);
+    if (removed_it != removed.end() && *removed_it == item) {
+        return -1;
+    }
+    item -= static_cast<int>(removed_it - removed.begin());
+
+    // The i-th inserted item has (inserted[i] - i) of the remaining items in front of it, so it goes in front of `item`
+    // iff that is at most `item`
+    auto& inserted = change.InsertedItems;
+    int begin = 0;
+    int end = static_cast<int>(inserted.size());
+    while (begin < end) {
+        int mid = begin + (end - begin) / 2;
+        if (inserted[mid] - mid <= item) {
+            begin = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return item + begin;
+}
+
+/// Maps the items of `results` from before `change` to after it, dropping the removed ones. Their order is kept, which
+/// is still the ranking order since the remaining items keep their relative order.
+static void RemapItems(std::vector<SearchResult>& results, const CommandItemChange& change)
+{
+    if (change.RemovedItems.empty() && change.InsertedItems.empty()) {
+        return;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < results.size(); ++i) {
+        int item = RemapItem(results[i].ItemIndex, change);
+        if (item != -1) {
+            results[count] = results[i];
+            results[count].ItemIndex = item;
+            ++count;
+        }
+    }
+    results.resize(count);
+}
+
+bool SearchJob::ApplyItemChanges(const SearchSettings& settings, int& tracked_item)
+{
+    auto& gg = *m_Instance->Owner;
+    if (m_Searching || !m_Results || m_LastSearchText[0] == '\0') {
+        return false;
+    }
+    int first_change = gg.FindItemChanges(m_LastSearchGeneration);
+    if (first_change == -1) {
+        return false;
+    }
+
+    // The new items become the candidates, the same way narrowing down scores only some of the items
+    auto& results = *m_Results;
+    m_Candidates.clear();
+    for (int i = first_change; i < static_cast<int>(gg.ItemChanges.size()); ++i) {
+        auto& change = gg.ItemChanges[i];
+        RemapItems(results, change);
+        RemapItems(m_Candidates, change);
+        if (tracked_item != -1) {
+            tracked_item = RemapItem(tracked_item, change);
+        }
+        for (int item : change.InsertedItems) {
+            SearchResult candidate = {};
+            candidate.ItemIndex = item;
+            m_Candidates.push_back(candidate);
+        }
+    }
+
+    m_Settings = settings;
+    m_ItemCount = m_Instance->Session.GetItemCount();
+    m_CandidateCount = static_cast<int>(m_Candidates.size());
+    m_NextCandidate = 0;
+    m_Narrowing = true;
+    IMCMD_STATS(m_Stats = {});
+    IMCMD_STATS(m_Stats.ItemChangesApplied = static_cast<int>(gg.ItemChanges.size()) - first_change);
+    if (m_CandidateCount > 0) {
+        // Usually a handful, so score them right away instead of spreading them across frames
+        m_Searching = true;
+        Step(std::numeric_limits<int>::max());
+    } else {
+        m_LastSearchGeneration = m_Settings.Generation;
+        m_LastSearchItemCount = m_ItemCount;
+    }
+    return true;
+}
+
+void SearchJob::Reset()
+{
+    m_LastSearchText[0] = '\0';
+    m_Searching = false;
+}
+
+void SearchJob::AddItems()
+{
+    int item_count = m_Instance->Session.GetItemCount();
+    if (!m_Results || item_count <= m_ItemCount) {
+        return;
+    }
+
+    if (m_Searching && m_Narrowing) {
+        m_Candidates.reserve(m_Candidates.size() + (item_count - m_ItemCount));
+        for (int i = m_ItemCount; i < item_count; ++i) {
+            SearchResult candidate = {};
+            candidate.ItemIndex = i;
+            m_Candidates.push_back(candidate);
+        }
+        m_CandidateCount = static_cast<int>(m_Candidates.size());
+    } else if (m_Searching) {
+        m_CandidateCount = item_count;
+    } else {
+        // Scan just the new items, their matches get merged into the results like those of any other step
+        m_Narrowing = false;
+        m_NextCandidate = m_ItemCount;
+        m_CandidateCount = item_count;
+        m_Searching = true;
+    }
+    m_ItemCount = item_count;
+}
+
+void SearchJob::Step(int count)
+{
+    if (!m_Searching) {
+        return;
+    }
+
+    m_StepEnd = m_NextCandidate + ImMin(count, m_CandidateCount - m_NextCandidate);
+    int step_size = m_StepEnd - m_NextCandidate;
+
+    // Not worth waking up other threads for less than this many candidates per chunk
+    constexpr int kMinChunkSize = 4096;
+    int chunk_count = 1;
+    auto workers = m_Settings.Workers;
+    if (workers) {
+        // Multiple chunks per thread, so that a thread that got unlucky with slow candidates doesn't hold up the others
+        chunk_count = ImMin(workers->GetThreadCount() * 4, step_size / kMinChunkSize);
+        chunk_count = ImMax(chunk_count, 1);
+    }
+    m_ChunkSize = (step_size + chunk_count - 1) / chunk_count;
+    if (static_cast<int>(m_ChunkResults.size()) < chunk_count) {
+        m_ChunkResults.resize(chunk_count);
+        m_ChunkTruncated.resize(chunk_count);
+        m_ChunkStats.resize(chunk_count);
+    }
+
+    {
+        IMCMD_STATS(StatsTimer timer(m_Stats.SearchTime));
+        if (chunk_count == 1) {
+            ScoreChunk(0);
+        } else {
+            workers->Run(
+                chunk_count,
+                [](void* user_data, int chunk) {
+                    static_cast<SearchJob*>(user_data)->ScoreChunk(chunk);
+                },
+                this);
+        }
+    }
+    {
+        IMCMD_STATS(StatsTimer timer(m_Stats.SortTime));
+        MergeChunks(chunk_count);
+    }
+
+    m_NextCandidate = m_StepEnd;
+    if (m_NextCandidate == m_CandidateCount) {
+        m_Searching = false;
+        ImStrncpy(m_LastSearchText, m_FoldedSearchText, IM_ARRAYSIZE(m_LastSearchText));
+        m_LastSearchGeneration = m_Settings.Generation;
+        m_LastSearchItemCount = m_ItemCount;
+    }
+}
+
+void SearchJob::ScoreChunk(int chunk)
+{
+    auto& results = m_ChunkResults[chunk];
+    results.clear();
+    m_ChunkTruncated[chunk] = false;
+
+    int max_results = m_Settings.MaxResults;
+
+    int begin = m_NextCandidate + chunk * m_ChunkSize;
+    int end = ImMin(begin + m_ChunkSize, m_StepEnd);
+    if (max_results > 0) {
+        // The heap never grows past this, so it is allocated at most once
+        results.reserve(ImMin(max_results, end - begin));
+    }
+    // Counted locally, the chunks' stats are next to each other in memory but written by different threads
+    IMCMD_STATS(CommandPaletteStats stats);
+    IMCMD_STATS(stats.CandidatesScanned = end - begin);
+    for (int i = begin; i < end; ++i) {
+        int item_idx = m_Narrowing ? m_Candidates[i].ItemIndex : i;
+        if ((m_SearchSignature & ~m_Instance->Session.GetItemSignature(item_idx)) != 0) {
+            IMCMD_STATS(++stats.PrefilterRejections);
+            continue;
+        }
+
+        const char* text = m_Instance->Session.GetItem(item_idx);
+        const char* folded_text = m_Instance->Session.GetFoldedItem(item_idx);
+        SearchResult result;
+        int recursions = 0;
+        bool matched;
+        if (folded_text) {
+            matched = FuzzySearchFolded(m_Settings.Algorithm, m_FoldedSearchText, folded_text, text, result.Score, result.Matches, IM_ARRAYSIZE(result.Matches), result.MatchCount, &recursions);
+        } else {
+            matched = FuzzySearch(m_Settings.Algorithm, m_SearchText, text, result.Score, result.Matches, IM_ARRAYSIZE(result.Matches), result.MatchCount, &recursions);
+        }
+        IMCMD_STATS(++stats.MatcherCalls);
+        IMCMD_STATS(stats.MatcherRecursions += recursions);
+        if (matched) {
+            IMCMD_STATS(++stats.ResultsProduced);
+            result.ItemIndex = item_idx;
+            if (max_results <= 0) {
+                if (results.size() == results.capacity()) {
+                    // Grow straight to the most matches the chunk can still produce, instead of reallocating
+                    // O(log(matches)) times
+                    results.reserve(results.size() + (end - i));
+                }
+                results.push_back(result);
+            } else if (static_cast<int>(results.size()) < max_results) {
+                results.push_back(result);
+                std::push_heap(results.begin(), results.end(), &IsRankedBefore);
+            } else {
+                // The heap's front is the worst match kept so far, replace it if this one ranks better
+                m_ChunkTruncated[chunk] = true;
+                if (IsRankedBefore(result, results.front())) {
+                    std::pop_heap(results.begin(), results.end(), &IsRankedBefore);
+                    results.back() = result;
+                    std::push_heap(results.begin(), results.end(), &IsRankedBefore);
+                }
+            }
+        }
+    }
+
+    // Sort on the worker, so that only merging the chunks is left to the calling thread
+    if (max_results <= 0) {
+        std::sort(results.begin(), results.end(), &IsRankedBefore);
+    } else {
+        std::sort_heap(results.begin(), results.end(), &IsRankedBefore);
+    }
+    IMCMD_STATS(m_ChunkStats[chunk] = stats);
+}
+
+void SearchJob::MergeChunks(int chunk_count)
+{
+    for (int i = 0; i < chunk_count; ++i) {
+        m_Truncated |= m_ChunkTruncated[i] != 0;
+        IMCMD_STATS(AddSearchStats(m_Stats, m_ChunkStats[i]));
+    }
+
+    auto& results = *m_Results;
+    if (chunk_count == 1 && results.empty()) {
+        // Keep the old results' storage around for the next search
+        std::swap(results, m_ChunkResults[0]);
+        return;
+    }
+
+    // Pairwise merge of the results so far and the sorted chunks, ping-ponging between the results and m_MergeBuffer.
+    // Since IsRankedBefore() is a total order, this produces exactly the same ranking as sorting all results at once.
+    size_t total_count = results.size();
+    for (int i = 0; i < chunk_count; ++i) {
+        total_count += m_ChunkResults[i].size();
+    }
+    results.reserve(total_count);
+    m_RunEnds.clear();
+    m_RunEnds.push_back(static_cast<int>(results.size()));
+    for (int i = 0; i < chunk_count; ++i) {
+        results.insert(results.end(), m_ChunkResults[i].begin(), m_ChunkResults[i].end());
+        m_RunEnds.push_back(static_cast<int>(results.size()));
+    }
+
+    while (m_RunEnds.size() > 1) {
+        m_MergeBuffer.resize(results.size());
+
+        size_t merged_runs = 0;
+        int run_begin = 0;
+        for (size_t i = 0; i < m_RunEnds.size(); i += 2) {
+            int run_end = m_RunEnds[i];
+            if (i + 1 < m_RunEnds.size()) {
+                int next_run_end = m_RunEnds[i + 1];
+                std::merge(
+                    results.begin() + run_begin,
+                    results.begin() + run_end,
+                    results.begin() + run_end,
+                    results.begin() + next_run_end,
+                    m_MergeBuffer.begin() + run_begin,
+                    &IsRankedBefore);
+                run_end = next_run_end;
+            } else {
+                std::copy(results.begin() + run_begin, results.begin() + run_end, m_MergeBuffer.begin() + run_begin);
+            }
+            m_RunEnds[merged_runs++] = run_end;
+            run_begin = run_end;
+        }
+        m_RunEnds.resize(merged_runs);
+
+        std::swap(results, m_MergeBuffer);
+    }
+
+    int max_results = m_Settings.MaxResults;
+    if (max_results > 0 && static_cast<int>(results.size()) > max_results) {
+        results.resize(max_results);
+        m_Truncated = true;
+    }
+}
+
+BackgroundSearchWorker::BackgroundSearchWorker(Instance& instance)
+    : m_Job(instance)
+{
+    m_Thread = std::thread(&BackgroundSearchWorker::WorkerMain, this);
+}
+
+BackgroundSearchWorker::~BackgroundSearchWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stopping = true;
+        // Also cancels the search in progress
+        ++m_RequestId;
+    }
+    m_RequestAvailable.notify_one();
+    m_Thread.join();
+}
+
+bool BackgroundSearchWorker::IsBusy()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_FinishedRequestId != m_RequestId || m_PublishedRequestId != m_ConsumedRequestId;
+}
+
+bool BackgroundSearchWorker::IsSearching()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_FinishedRequestId != m_RequestId;
+}
+
+void BackgroundSearchWorker::Request(const char* text, const SearchSettings& settings)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        ImStrncpy(m_RequestText, text, IM_ARRAYSIZE(m_RequestText));
+        m_RequestSettings = settings;
+        ++m_RequestId;
+    }
+    m_RequestAvailable.notify_one();
+}
+
+void BackgroundSearchWorker::Cancel()
+{
+    // An empty request finishes right away
+    Request("", SearchSettings{});
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_RequestFinished.wait(lock, [&]() { return m_FinishedRequestId == m_RequestId; });
+}
+
+bool BackgroundSearchWorker::ConsumeResults(std::vector<SearchResult>& results, bool& truncated, CommandPaletteStats& stats, int generation, bool& latest)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_PublishedRequestId == m_ConsumedRequestId) {
+        return false;
+    }
+
+    m_ConsumedRequestId = m_PublishedRequestId;
+    if (m_PublishedGeneration != generation) {
+        // Item indices in these results don't refer to the current items anymore
+        return false;
+    }
+
+    std::swap(results, m_PublishedResults);
+    truncated = m_PublishedTruncated;
+    stats = m_PublishedStats;
+    latest = m_PublishedRequestId == m_RequestId;
+    return true;
+}
+
+void BackgroundSearchWorker::DiscardResults()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_ConsumedRequestId = m_PublishedRequestId;
+}
+
+void BackgroundSearchWorker::WorkerMain()
+{
+    char text[IM_ARRAYSIZE(m_RequestText)];
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (true) {
+        m_RequestAvailable.wait(lock, [&]() { return m_Stopping || m_FinishedRequestId != m_RequestId; });
+        if (m_Stopping) {
+            return;
+        }
+
+        int request_id = m_RequestId;
+        auto settings = m_RequestSettings;
+        ImStrncpy(text, m_RequestText, IM_ARRAYSIZE(text));
+        lock.unlock();
+
+        bool completed = false;
+        if (text[0] != '\0') {
+            m_Job.Restart(text, settings, m_Results);
+            while (m_Job.IsSearching() && m_RequestId == request_id) {
+                m_Job.Step(m_Job.GetStepSize());
+            }
+            completed = !m_Job.IsSearching();
+        }
+        // Otherwise just stop, the job's state stays usable for narrowing down the next search (if its items didn't
+        // change in the meantime, which it checks for itself)
+
+        if (completed) {
+            // Copy outside of the lock, m_Results is still needed for narrowing down the next search
+            m_StagingResults = m_Results;
+        }
+
+        lock.lock();
+        if (completed) {
+            std::swap(m_PublishedResults, m_StagingResults);
+            m_PublishedRequestId = request_id;
+            m_PublishedGeneration = settings.Generation;
+            m_PublishedTruncated = m_Job.IsTruncated();
+            m_PublishedStats = m_Job.GetStats();
+        }
+        m_FinishedRequestId = request_id;
+        m_RequestFinished.notify_all();
+    }
+}
+
+SearchWorkerPool::SearchWorkerPool(int thread_count)
+{
+    // The calling thread of Run() also works on the chunks
+    for (int i = 0; i < thread_count - 1; ++i) {
+        m_Threads.emplace_back(&SearchWorkerPool::WorkerMain, this);
+    }
+}
+
+SearchWorkerPool::~SearchWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stopping = true;
+    }
+    m_WorkAvailable.notify_all();
+    for (auto& thread : m_Threads) {
+        thread.join();
+    }
+}
+
+void SearchWorkerPool::Run(int chunk_count, TaskFunc task, void* user_data)
+{
+    std::lock_guard<std::mutex> run_lock(m_RunMutex);
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        // A worker that woke up too late for the previous task might still be in RunChunks(), it must not pick up
+        // chunks of this one as chunks of the previous task
+        m_WorkDone.wait(lock, [&]() { return m_ActiveWorkers == 0; });
+        m_Task = task;
+        m_TaskUserData = user_data;
+        m_ChunkCount = chunk_count;
+        m_NextChunk = 0;
+        m_CompletedChunks = 0;
+        ++m_TaskId;
+    }
+    m_WorkAvailable.notify_all();
+
+    int completed = RunChunks(task, user_data, chunk_count);
 
-        m_ExecutingCommand = nullptr;
-        m_CallStack.clear();
-        --gContext->CommandStorageLocks;
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_CompletedChunks += completed;
+    m_WorkDone.wait(lock, [&]() { return m_CompletedChunks == m_ChunkCount; });
+}
 
-        // If the executed command involved subcommands...
-        if (final_call_stack_height > 0) {
-            m_Instance->PendingActions.ClearSearch = true;
-            m_Instance->CurrentSelectedItem = 0;
+void SearchWorkerPool::WorkerMain()
+{
+    int last_task_id = 0;
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (true) {
+        m_WorkAvailable.wait(lock, [&]() { return m_Stopping || m_TaskId != last_task_id; });
+        if (m_Stopping) {
+            return;
         }
-
-        gContext->LastCommandPaletteStatus.ItemSelected = true;
-    } else {
-        // Something new is prompted
-        // It doesn't make sense for "current selected item" to persists through completely different set of options
-        m_Instance->PendingActions.ClearSearch = true;
-        m_Instance->CurrentSelectedItem = 0;
+        last_task_id = m_TaskId;
+        // Run() may publish the next task while this one is still running, only read it under the lock
+        auto task = m_Task;
+        auto user_data = m_TaskUserData;
+        int chunk_count = m_ChunkCount;
+
+        ++m_ActiveWorkers;
+        lock.unlock();
+        int completed = RunChunks(task, user_data, chunk_count);
+        lock.lock();
+        --m_ActiveWorkers;
+
+        m_CompletedChunks += completed;
+        m_WorkDone.notify_one();
     }
 }
 
-void ExecutionManager::PushOptions(std::vector<std::string> options)
+int SearchWorkerPool::RunChunks(TaskFunc task, void* user_data, int chunk_count)
 {
-    m_CallStack.push_back({});
-    auto& frame = m_CallStack.back();
-
-    frame.Options = std::move(options);
+    int completed = 0;
+    int chunk;
+    while ((chunk = m_NextChunk.fetch_add(1)) < chunk_count) {
+        task(user_data, chunk);
+        ++completed;
+    }
+    return completed;
+}
 
-    m_Instance->PendingActions.ClearSearch = true;
+ImU32 CommandNameIndex::HashName(const char* name)
+{
+    // FNV-1a over the upper-cased name, to agree with ImStricmp()
+    ImU32 hash = 2166136261u;
+    for (; *name; ++name) {
+        char c = *name;
+        if (c >= 'a' && c <= 'z') {
+            c = static_cast<char>(c - 'a' + 'A');
+        }
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    return hash;
 }
 
-int SearchManager::GetItemCount() const
+void CommandNameIndex::Insert(const char* name, int slot)
 {
-    return static_cast<int>(SearchResults.size());
+    // Keep the load factor (including removed buckets) under 3/4
+    if ((m_UsedBuckets + 1) * 4 > static_cast<int>(m_Buckets.size()) * 3) {
+        int bucket_count = 16;
+        while (bucket_count < (m_Count + 1) * 2) {
+            bucket_count *= 2;
+        }
+        Rehash(bucket_count);
+    }
+
+    ImU32 hash = HashName(name);
+    size_t mask = m_Buckets.size() - 1;
+    size_t i = hash & mask;
+    while (m_Buckets[i].Slot >= 0) {
+        i = (i + 1) & mask;
+    }
+    if (m_Buckets[i].Slot == kEmpty) {
+        ++m_UsedBuckets;
+    }
+    m_Buckets[i] = Bucket{ hash, slot };
+    ++m_Count;
 }
 
-const char* SearchManager::GetItem(int idx) const
+int CommandNameIndex::Find(const char* name, const std::vector<Command>& commands) const
 {
-    int actualIdx = SearchResults[idx].ItemIndex;
-    return m_Instance->Session.GetItem(actualIdx);
+    if (m_Buckets.empty()) {
+        return -1;
+    }
+
+    ImU32 hash = HashName(name);
+    size_t mask = m_Buckets.size() - 1;
+    for (size_t i = hash & mask; m_Buckets[i].Slot != kEmpty; i = (i + 1) & mask) {
+        auto& bucket = m_Buckets[i];
+        if (bucket.Slot >= 0 && bucket.Hash == hash && ImStricmp(commands[bucket.Slot].Name.c_str(), name) == 0) {
+            return bucket.Slot;
+        }
+    }
+    return -1;
 }
 
-bool SearchManager::IsActive() const
+void CommandNameIndex::RemoveAll(const char* name, const std::vector<Command>& commands, std::vector<int>& out_slots)
 {
-    return SearchText[0] != '\0';
+    if (m_Buckets.empty()) {
+        return;
+    }
+
+    ImU32 hash = HashName(name);
+    size_t mask = m_Buckets.size() - 1;
+    for (size_t i = hash & mask; m_Buckets[i].Slot != kEmpty; i = (i + 1) & mask) {
+        auto& bucket = m_Buckets[i];
+        if (bucket.Slot >= 0 && bucket.Hash == hash && ImStricmp(commands[bucket.Slot].Name.c_str(), name) == 0) {
+            out_slots.push_back(bucket.Slot);
+            bucket.Slot = kRemoved;
+            --m_Count;
+        }
+    }
 }
 
-void SearchManager::SetSearchText(const char* text)
+void CommandNameIndex::Rehash(int bucket_count)
 {
-    // Copy at most IM_ARRAYSIZE(SearchText) chars from `text` to `SearchText`
-    ImStrncpy(SearchText, text, IM_ARRAYSIZE(SearchText));
-    RefreshSearchResults();
+    std::vector<Bucket> old_buckets(bucket_count, Bucket{ 0, kEmpty });
+    std::swap(m_Buckets, old_buckets);
+    m_UsedBuckets = m_Count;
+
+    size_t mask = m_Buckets.size() - 1;
+    for (auto& bucket : old_buckets) {
+        if (bucket.Slot < 0) {
+            continue;
+        }
+        size_t i = bucket.Hash & mask;
+        while (m_Buckets[i].Slot != kEmpty) {
+            i = (i + 1) & mask;
+        }
+        m_Buckets[i] = bucket;
+    }
 }
 
-void SearchManager::ClearSearchText()
+void RowLayoutCache::Validate(ImFont* font_regular, float font_size_regular, ImFont* font_highlight, float font_size_highlight, int generation)
 {
-    // ImGui doesn't have a ImMemset either, they use std::memset too
-    std::memset(SearchText, 0, IM_ARRAYSIZE(SearchText));
-    SearchResults.clear();
+    if (m_FontRegular != font_regular ||
+        m_FontHighlight != font_highlight ||
+        m_FontSizeRegular != font_size_regular ||
+        m_FontSizeHighlight != font_size_highlight ||
+        m_Generation != generation)
+    {
+        Clear();
+        m_FontRegular = font_regular;
+        m_FontHighlight = font_highlight;
+        m_FontSizeRegular = font_size_regular;
+        m_FontSizeHighlight = font_size_highlight;
+        m_Generation = generation;
+    }
 }
 
-void SearchManager::RefreshSearchResults()
+RowLayout RowLayoutCache::GetLayout(const SearchResult& result, const char* text)
 {
-    m_Instance->CurrentSelectedItem = 0;
-    SearchResults.clear();
+    // About a few screens worth of rows, start over instead of tracking which ones are least recently used
+    constexpr int kMaxCachedRows = 1024;
+    // Rows that outgrow their segments when laid out again leave them behind, start over once too many piled up
+    constexpr size_t kMaxCachedSegments = kMaxCachedRows * 16;
+
+    auto key = static_cast<ImGuiID>(result.ItemIndex);
+    int row_idx = m_RowLookup.GetInt(key) - 1;
+    if (row_idx >= 0) {
+        auto& row = m_Rows[row_idx];
+        if (row.MatchCount == result.MatchCount && std::memcmp(row.Matches, result.Matches, result.MatchCount * sizeof(*result.Matches)) == 0) {
+            return RowLayout{ m_Segments.data() + row.FirstSegment, row.SegmentCount, row.TailBegin };
+        }
+    }
+    if (m_Segments.size() >= kMaxCachedSegments || (row_idx < 0 && static_cast<int>(m_Rows.size()) >= kMaxCachedRows)) {
+        Clear();
+        row_idx = -1;
+    }
+    if (row_idx < 0) {
+        row_idx = static_cast<int>(m_Rows.size());
+        m_Rows.push_back({});
+        m_RowLookup.SetInt(key, row_idx + 1);
+    }
 
-    int item_count = m_Instance->Session.GetItemCount();
-    for (int i = 0; i < item_count; ++i) {
-        const char* text = m_Instance->Session.GetItem(i);
-        SearchResult result;
-        if (FuzzySearch(SearchText, text, result.Score, result.Matches, IM_ARRAYSIZE(result.Matches), result.MatchCount)) {
-            result.ItemIndex = i;
-            SearchResults.push_back(result);
+    // (Re)layout the row, appending its segments and moving them into the row's old ones if they fit
+    auto& row = m_Rows[row_idx];
+    row.MatchCount = result.MatchCount;
+    std::memcpy(row.Matches, result.Matches, result.MatchCount * sizeof(*result.Matches));
+    int first_segment = static_cast<int>(m_Segments.size());
+
+    auto AddSegment = [&](int begin, int end, bool highlighted) {
+        ImFont* font = highlighted ? m_FontHighlight : m_FontRegular;
+        float font_size = highlighted ? m_FontSizeHighlight : m_FontSizeRegular;
+        auto size = font->CalcTextSizeA(font_size, std::numeric_limits<float>::max(), 0.0f, text + begin, text + end);
+        m_Segments.push_back(RowSegment{ begin, end, size.x, size.y, highlighted });
+    };
+
+    // Matches point at the first byte of each matched character, this finds the end of the character
+    auto GetCharEnd = [&](int begin) -> int {
+        int end = begin + 1;
+        while ((static_cast<unsigned char>(text[end]) & 0xC0) == 0x80) {
+            ++end;
+        }
+        return end;
+    };
+
+    // Consecutive matched characters form one highlighted segment, with the unmatched characters before it as another
+    int last_range_end = 0;
+    int j = 0;
+    while (j < result.MatchCount) {
+        int range_begin = result.Matches[j];
+        int range_end = GetCharEnd(range_begin);
+        for (++j; j < result.MatchCount && result.Matches[j] == range_end; ++j) {
+            range_end = GetCharEnd(range_end);
         }
+
+        if (range_begin != last_range_end) {
+            AddSegment(last_range_end, range_begin, false);
+        }
+        AddSegment(range_begin, range_end, true);
+        last_range_end = range_end;
+    }
+
+    row.SegmentCount = static_cast<int>(m_Segments.size()) - first_segment;
+    if (row.SegmentCount <= row.SegmentCapacity) {
+        std::copy(m_Segments.begin() + first_segment, m_Segments.end(), m_Segments.begin() + row.FirstSegment);
+        m_Segments.resize(first_segment);
+    } else {
+        row.FirstSegment = first_segment;
+        row.SegmentCapacity = row.SegmentCount;
     }
+    row.TailBegin = last_range_end;
+    return RowLayout{ m_Segments.data() + row.FirstSegment, row.SegmentCount, row.TailBegin };
+}
 
-    std::sort(
-        SearchResults.begin(),
-        SearchResults.end(),
-        [](const SearchResult& a, const SearchResult& b) -> bool {
-            // We want the biggest element first
-            return a.Score > b.Score;
-        });
+void RowLayoutCache::Clear()
+{
+    // ImGuiStorage::Clear() frees its storage, only drop the entries so that refilling the cache doesn't allocate
+    m_RowLookup.Data.resize(0);
+    m_Rows.clear();
+    m_Segments.clear();
 }
 
 // =================================================================
@@ -421,39 +2546,89 @@ Context* GetCurrentContext()
 void AddCommand(Command command)
 {
     IM_ASSERT(gContext != nullptr);
+    gContext->FlushPendingOps();
 
     if (gContext->IsCommandStorageLocked()) {
-        gContext->PendingRegisterOps.push_back(CommandOperationRegister{ std::move(command) });
-        CommandOperation op;
-        op.Type = CommandOperation::OpType_Register;
-        op.Index = static_cast<int>(gContext->PendingRegisterOps.size()) - 1;
-        gContext->PendingOps.push_back(op);
+        gContext->AddPendingOp(CommandOperation::OpType_Register, gContext->PendingRegisterOps, CommandOperationRegister{ std::move(command) });
     } else {
         gContext->RegisterCommand(std::move(command));
     }
+}
 
-    if (auto current = gContext->CurrentCommandPalette) {
-        current->PendingActions.RefreshSearch = true;
+void AddCommands(std::vector<Command> commands)
+{
+    IM_ASSERT(gContext != nullptr);
+    gContext->FlushPendingOps();
+
+    if (gContext->IsCommandStorageLocked()) {
+        // CommitOps() merges these back into one batch
+        for (auto& command : commands) {
+            gContext->AddPendingOp(CommandOperation::OpType_Register, gContext->PendingRegisterOps, CommandOperationRegister{ std::move(command) });
+        }
+    } else {
+        gContext->RegisterCommands(commands);
     }
 }
 
 void RemoveCommand(const char* name)
 {
     IM_ASSERT(gContext != nullptr);
+    gContext->FlushPendingOps();
 
     if (gContext->IsCommandStorageLocked()) {
-        gContext->PendingUnregisterOps.push_back(CommandOperationUnregister{ name });
-        CommandOperation op;
-        op.Type = CommandOperation::OpType_Unregister;
-        op.Index = static_cast<int>(gContext->PendingUnregisterOps.size()) - 1;
-        gContext->PendingOps.push_back(op);
+        gContext->AddPendingOp(CommandOperation::OpType_Unregister, gContext->PendingUnregisterOps, CommandOperationUnregister{ name });
     } else {
         gContext->UnregisterCommand(name);
     }
+}
+
+void QueueAddCommand(Context* context, Command command)
+{
+    IM_ASSERT(context != nullptr);
+
+    auto op = new QueuedCommandOperation();
+    op->Type = CommandOperation::OpType_Register;
+    op->Commands.push_back(std::move(command));
+    context->QueuedOps.Push(op);
+}
+
+void QueueAddCommands(Context* context, std::vector<Command> commands)
+{
+    IM_ASSERT(context != nullptr);
 
-    if (auto current = gContext->CurrentCommandPalette) {
-        current->PendingActions.RefreshSearch = true;
+    if (commands.empty()) {
+        return;
     }
+    // One operation for all of them, CommitOps() registers them in one batch anyway
+    auto op = new QueuedCommandOperation();
+    op->Type = CommandOperation::OpType_Register;
+    op->Commands = std::move(commands);
+    context->QueuedOps.Push(op);
+}
+
+void QueueRemoveCommand(Context* context, const char* name)
+{
+    IM_ASSERT(context != nullptr);
+    IM_ASSERT(name != nullptr);
+
+    auto op = new QueuedCommandOperation();
+    op->Type = CommandOperation::OpType_Unregister;
+    op->Name = name;
+    context->QueuedOps.Push(op);
+}
+
+const Command* FindCommand(const char* name)
+{
+    IM_ASSERT(gContext != nullptr);
+    gContext->FlushPendingOps();
+
+    int slot = gContext->CommandIndex.Find(name, gContext->Commands);
+    return slot >= 0 ? &gContext->Commands[slot] : nullptr;
+}
+
+bool HasCommand(const char* name)
+{
+    return FindCommand(name) != nullptr;
 }
 
 bool GetStyleFlag(ImCmdTextType type, ImCmdTextFlag flag)
@@ -503,6 +2678,108 @@ void ClearStyleColor(ImCmdTextType type)
     gContext->TextStyleHasColorOverride[type] = false;
 }
 
+FuzzySearchAlgorithm GetSearchAlgorithm()
+{
+    IM_ASSERT(gContext != nullptr);
+    return gContext->SearchAlgorithm;
+}
+
+void SetSearchAlgorithm(FuzzySearchAlgorithm algorithm)
+{
+    IM_ASSERT(gContext != nullptr);
+    gContext->SearchAlgorithm = algorithm;
+}
+
+int GetSearchThreadCount()
+{
+    IM_ASSERT(gContext != nullptr);
+    return gContext->SearchWorkers ? gContext->SearchWorkers->GetThreadCount() : 1;
+}
+
+void SetSearchThreadCount(int count)
+{
+    IM_ASSERT(gContext != nullptr);
+    IM_ASSERT(count >= 1);
+    if (count == GetSearchThreadCount()) {
+        return;
+    }
+
+    // Background searches might be using the current worker pool
+    for (auto& entry : gContext->Instances.Data) {
+        if (auto instance = reinterpret_cast<Instance*>(entry.val_p)) {
+            instance->Search.CancelBackgroundSearch();
+            instance->PendingActions.RefreshSearch = true;
+        }
+    }
+
+    delete gContext->SearchWorkers;
+    gContext->SearchWorkers = count > 1 ? new SearchWorkerPool(count) : nullptr;
+}
+
+int GetSearchTimeBudget()
+{
+    IM_ASSERT(gContext != nullptr);
+    return gContext->SearchTimeBudget;
+}
+
+void SetSearchTimeBudget(int microseconds)
+{
+    IM_ASSERT(gContext != nullptr);
+    IM_ASSERT(microseconds >= 0);
+    gContext->SearchTimeBudget = microseconds;
+}
+
+int GetSearchItemBudget()
+{
+    IM_ASSERT(gContext != nullptr);
+    return gContext->SearchItemBudget;
+}
+
+void SetSearchItemBudget(int count)
+{
+    IM_ASSERT(gContext != nullptr);
+    IM_ASSERT(count >= 0);
+    gContext->SearchItemBudget = count;
+}
+
+int GetMaxSearchResults()
+{
+    IM_ASSERT(gContext != nullptr);
+    return gContext->MaxSearchResults;
+}
+
+void SetMaxSearchResults(int count)
+{
+    IM_ASSERT(gContext != nullptr);
+    IM_ASSERT(count >= 0);
+    gContext->MaxSearchResults = count;
+}
+
+int GetSearchCacheSize()
+{
+    IM_ASSERT(gContext != nullptr);
+    return gContext->SearchCacheSize;
+}
+
+void SetSearchCacheSize(int bytes)
+{
+    IM_ASSERT(gContext != nullptr);
+    IM_ASSERT(bytes >= 0);
+    gContext->SearchCacheSize = bytes;
+}
+
+bool GetSearchInBackground()
+{
+    IM_ASSERT(gContext != nullptr);
+    return gContext->SearchInBackground;
+}
+
+void SetSearchInBackground(bool enabled)
+{
+    IM_ASSERT(gContext != nullptr);
+    gContext->SearchInBackground = enabled;
+}
+
 void SetNextCommandPaletteSearch(const char* text)
 {
     IM_ASSERT(gContext != nullptr);
@@ -526,7 +2803,7 @@ void CommandPalette(const char* name)
         if (auto ptr = gg.Instances.GetVoidPtr(id)) {
             return reinterpret_cast<Instance*>(ptr);
         } else {
-            auto instance = new Instance();
+            auto instance = new Instance(gg);
             gg.Instances.SetVoidPtr(id, instance);
             return instance;
         }
@@ -542,8 +2819,19 @@ void CommandPalette(const char* name)
     gg.LastCommandPaletteStatus = {};
 
     // BEGIN processing PendingActions
+    if (!gg.PendingOps.empty() || !gg.QueuedOps.IsEmpty()) {
+        // Pending commands operations can't be committed while they are being searched in the background
+        gi.Search.CancelBackgroundSearch();
+    }
+    gi.Session.ReceiveOptions();
     bool refresh_search = gi.PendingActions.RefreshSearch;
-    refresh_search |= gg.CommitOps();
+    int compactions = gg.CommandCompactions;
+    gg.CommitOps();
+    gi.Stats.CommandCompactions = gg.CommandCompactions - compactions;
+    // Commands might have been added/removed since the last search, including while this command palette was not being drawn
+    if (!refresh_search && gi.Search.IsOutdated()) {
+        refresh_search = !gi.Search.UpdateResults();
+    }
 
     if (auto text = gg.NextCommandPaletteActions.NewSearchText) {
         refresh_search = false;
@@ -574,6 +2862,16 @@ void CommandPalette(const char* name)
         // Search string updated, update search results
         gi.Search.RefreshSearchResults();
     }
+    gi.Search.ContinueSearch();
+    if (gi.Search.IsSearching() || gi.Session.IsReceivingOptions()) {
+        // Partial results are shown while a search spans multiple frames, let the user know there might be more
+        const char* label = "Searching...";
+        ImVec2 label_size = ImGui::CalcTextSize(label);
+        ImVec2 label_pos(
+            ImGui::GetItemRectMax().x - ImGui::GetStyle().FramePadding.x - label_size.x,
+            ImGui::GetItemRectMin().y + ImGui::GetStyle().FramePadding.y);
+        ImGui::GetWindowDrawList()->AddText(label_pos, ImGui::GetColorU32(ImGuiCol_TextDisabled), label);
+    }
 
     ImGui::BeginChild("SearchResults", ImVec2(width, search_result_window_height));
 
@@ -612,6 +2910,9 @@ void CommandPalette(const char* name)
     // Could be 0.5 on macOS Retina, 1 elsewhere
     float font_scale = ImGui::GetIO().FontGlobalScale;
 
+    // Measured segments stay valid as long as the fonts they were measured with and the set of items don't change
+    gi.RowLayouts.Validate(font_regular, font_regular->FontSize, font_highlight, font_highlight->FontSize * font_scale, gg.CommandSetGeneration);
+
     int item_count;
     if (gi.Search.IsActive()) {
         item_count = gi.Search.GetItemCount();
@@ -619,147 +2920,163 @@ void CommandPalette(const char* name)
         item_count = gi.Session.GetItemCount();
     }
 
-    if (gi.ExtraData.size() < item_count) {
-        gi.ExtraData.resize(item_count);
-    }
+    // Every row has the same height, so only the visible ones need to be laid out and drawn
+    float item_height = ImMax(font_regular->FontSize, font_highlight->FontSize);
+    float row_height = item_height + ImGui::GetStyle().ItemSpacing.y;
+    float list_start_y = ImGui::GetCursorPosY();
+    int visible_begin = item_count;
+    int visible_end = 0;
+
+#if !defined(IMCMD_DISABLE_STATS)
+    float layout_time = 0.0f;
+    auto draw_start_time = std::chrono::steady_clock::now();
+    int draw_start_vertex = draw_list->VtxBuffer.Size;
+#endif
 
     // Flag used to delay item selection until after the loop ends
     bool select_focused_item = false;
-    for (int i = 0; i < item_count; ++i) {
-        // Implement a custom button-like control
-
-        // We are doing this so that it can be highlighted without losing focus on the ImGui::InputText,
-        // allowing the user to naviage with up/down arrow keys while typing.
-
-        auto id = window->GetID(static_cast<int>(i));
-
-        ImVec2 size{
-            ImGui::GetContentRegionAvail().x,
-            ImMax(font_regular->FontSize, font_highlight->FontSize),
-        };
-        ImRect rect{
-            window->DC.CursorPos,
-            window->DC.CursorPos + ImGui::CalcItemSize(size, 0.0f, 0.0f),
-        };
-
-        bool& hovered = gi.ExtraData[i].Hovered;
-        bool& held = gi.ExtraData[i].Held;
-        if (held && hovered) {
-            draw_list->AddRectFilled(rect.Min, rect.Max, item_active_color);
-        } else if (hovered) {
-            draw_list->AddRectFilled(rect.Min, rect.Max, item_hovered_color);
-        } else if (gi.CurrentSelectedItem == i) {
-            draw_list->AddRectFilled(rect.Min, rect.Max, item_selected_color);
-        }
-
-        if (gi.Search.IsActive()) {
-            // Iterating search results: draw text with highlights at matched chars
-
-            auto& search_result = gi.Search.SearchResults[i];
-            auto text = gi.Search.GetItem(i);
-
-            auto text_pos = window->DC.CursorPos;
-            int range_begin;
-            int range_end;
-            int last_range_end = 0;
-
-            auto DrawCurrentRange = [&]() {
-                if (range_begin != last_range_end) {
-                    // Draw normal text between last highlighted range end and current highlighted range start
-                    auto begin = text + last_range_end;
-                    auto end = text + range_begin;
-
-                    draw_list->AddText(text_pos, text_color_regular, begin, end);
-                    auto segment_size = font_regular->CalcTextSizeA(font_regular->FontSize, std::numeric_limits<float>::max(), 0.0f, begin, end);
-
-                    if (underline_regular) {
-                        float x1 = text_pos.x;
-                        float x2 = text_pos.x + segment_size.x;
-                        float y = text_pos.y + segment_size.y;
-                        // TODO adjust this to be at text baseline instead
-                        draw_list->AddLine(ImVec2(x1, y), ImVec2(x2, y), text_color_regular);
-                    }
-
-                    text_pos.x += segment_size.x;
-                }
+    ImGuiListClipper clipper;
+    clipper.Begin(item_count, row_height);
+    while (clipper.Step()) {
+        visible_begin = ImMin(visible_begin, clipper.DisplayStart);
+        visible_end = ImMax(visible_end, clipper.DisplayEnd);
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+            // Implement a custom button-like control
+
+            // We are doing this so that it can be highlighted without losing focus on the ImGui::InputText,
+            // allowing the user to naviage with up/down arrow keys while typing.
+
+            auto id = window->GetID(static_cast<int>(i));
+
+            ImVec2 size{
+                ImGui::GetContentRegionAvail().x,
+                item_height,
+            };
+            ImRect rect{
+                window->DC.CursorPos,
+                window->DC.CursorPos + ImGui::CalcItemSize(size, 0.0f, 0.0f),
+            };
 
-                auto begin = text + range_begin;
-                auto end = text + range_end;
+            auto& extra_data = gi.GetExtraData(i);
+            bool& hovered = extra_data.Hovered;
+            bool& held = extra_data.Held;
+            if (held && hovered) {
+                draw_list->AddRectFilled(rect.Min, rect.Max, item_active_color);
+            } else if (hovered) {
+                draw_list->AddRectFilled(rect.Min, rect.Max, item_hovered_color);
+            } else if (gi.CurrentSelectedItem == i) {
+                draw_list->AddRectFilled(rect.Min, rect.Max, item_selected_color);
+            }
 
-                draw_list->AddText(font_highlight, font_highlight->FontSize * font_scale, text_pos, text_color_highlight, begin, end);
-                auto segment_size = font_highlight->CalcTextSizeA(font_highlight->FontSize * font_scale, std::numeric_limits<float>::max(), 0.0f, begin, end);
+            if (gi.Search.IsActive()) {
+                // Iterating search results: draw text with highlights at matched chars
 
-                if (underline_highlight) {
-                    float x1 = text_pos.x;
-                    float x2 = text_pos.x + segment_size.x;
-                    float y = text_pos.y + segment_size.y;
-                    // TODO adjust this to be at text baseline instead
-                    draw_list->AddLine(ImVec2(x1, y), ImVec2(x2, y), text_color_highlight);
+                auto& search_result = gi.Search.SearchResults[i];
+                auto text = gi.Search.GetItem(i);
+                RowLayout layout;
+                {
+                    IMCMD_STATS(StatsTimer timer(layout_time));
+                    layout = gi.RowLayouts.GetLayout(search_result, text);
                 }
 
-                text_pos.x += segment_size.x;
-            };
+                auto text_pos = window->DC.CursorPos;
+                for (int j = 0; j < layout.SegmentCount; ++j) {
+                    auto& segment = layout.Segments[j];
+                    auto begin = text + segment.Begin;
+                    auto end = text + segment.End;
+
+                    ImU32 color;
+                    bool underline;
+                    if (segment.Highlighted) {
+                        color = text_color_highlight;
+                        underline = underline_highlight;
+                        draw_list->AddText(font_highlight, font_highlight->FontSize * font_scale, text_pos, color, begin, end);
+                    } else {
+                        color = text_color_regular;
+                        underline = underline_regular;
+                        draw_list->AddText(text_pos, color, begin, end);
+                    }
+
+                    if (underline) {
+                        float x1 = text_pos.x;
+                        float x2 = text_pos.x + segment.Width;
+                        float y = text_pos.y + segment.Height;
+                        // TODO adjust this to be at text baseline instead
+                        draw_list->AddLine(ImVec2(x1, y), ImVec2(x2, y), color);
+                    }
 
-            IM_ASSERT(search_result.MatchCount >= 1);
-            range_begin = search_result.Matches[0];
-            range_end = range_begin;
-
-            int last_char_idx = -1;
-            for (int j = 0; j < search_result.MatchCount; ++j) {
-                int char_idx = search_result.Matches[j];
-
-                if (char_idx == last_char_idx + 1) {
-                    // These 2 indices are equal, extend our current range by 1
-                    ++range_end;
-                } else {
-                    DrawCurrentRange();
-                    last_range_end = range_end;
-                    range_begin = char_idx;
-                    range_end = char_idx + 1;
+                    text_pos.x += segment.Width;
                 }
 
-                last_char_idx = char_idx;
-            }
+                // Draw the text after the last range (if any)
+                draw_list->AddText(text_pos, text_color_regular, text + layout.TailBegin); // Draw until \0
+            } else {
+                // Iterating everything else: draw text as-is, there is no highlights
 
-            // Draw the remaining range (if any)
-            if (range_begin != range_end) {
-                DrawCurrentRange();
+                auto text = gi.Session.GetItem(i);
+                auto text_pos = window->DC.CursorPos;
+                draw_list->AddText(text_pos, text_color_regular, text);
             }
 
-            // Draw the text after the last range (if any)
-            draw_list->AddText(text_pos, text_color_regular, text + range_end); // Draw until \0
-        } else {
-            // Iterating everything else: draw text as-is, there is no highlights
-
-            auto text = gi.Session.GetItem(i);
-            auto text_pos = window->DC.CursorPos;
-            draw_list->AddText(text_pos, text_color_regular, text);
-        }
-
-        ImGui::ItemSize(rect);
-        if (!ImGui::ItemAdd(rect, id)) {
-            continue;
-        }
-        if (ImGui::ButtonBehavior(rect, id, &hovered, &held)) {
-            gi.CurrentSelectedItem = i;
-            select_focused_item = true;
+            ImGui::ItemSize(rect);
+            if (!ImGui::ItemAdd(rect, id)) {
+                continue;
+            }
+            if (ImGui::ButtonBehavior(rect, id, &hovered, &held)) {
+                gi.CurrentSelectedItem = i;
+                select_focused_item = true;
+            }
         }
     }
-
+    clipper.End();
+#if !defined(IMCMD_DISABLE_STATS)
+    gi.Stats.LayoutTime = layout_time;
+    gi.Stats.DrawTime = GetMicrosecondsSince(draw_start_time) - layout_time;
+    gi.Stats.VerticesEmitted = draw_list->VtxBuffer.Size - draw_start_vertex;
+#endif
+    // Rows scrolled out of view don't keep any state
+    gi.TrimExtraData(visible_begin, visible_end);
+
+    bool selection_moved = false;
     if (ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_UpArrow))) {
         gi.CurrentSelectedItem = ImMax(gi.CurrentSelectedItem - 1, 0);
+        selection_moved = true;
     } else if (ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_DownArrow))) {
-        gi.CurrentSelectedItem = ImMin(gi.CurrentSelectedItem + 1, item_count - 1);
+        gi.CurrentSelectedItem = ImMax(ImMin(gi.CurrentSelectedItem + 1, item_count - 1), 0);
+        selection_moved = true;
     }
-    if (ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Enter)) || select_focused_item) {
+    if (selection_moved) {
+        // Scroll the selected row into view, it might not even be laid out otherwise
+        float item_top = list_start_y + gi.CurrentSelectedItem * row_height;
+        float item_bottom = item_top + item_height;
+        float window_height = ImGui::GetWindowHeight();
+        if (item_top < ImGui::GetScrollY()) {
+            ImGui::SetScrollY(item_top);
+        } else if (item_bottom > ImGui::GetScrollY() + window_height) {
+            ImGui::SetScrollY(item_bottom - window_height);
+        }
+    }
+    // Nothing to select when the query matches nothing, or a prompt has no options (yet)
+    if ((ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Enter)) || select_focused_item) && item_count > 0) {
         if (gi.Search.IsActive() && !gi.Search.SearchResults.empty()) {
-            auto idx = gi.Search.SearchResults[gi.CurrentSelectedItem].ItemIndex;
-            gi.Session.SelectItem(idx);
+            // After ShowMoreResults(), the selection might be past the partial results of the search in progress
+            if (gi.CurrentSelectedItem < item_count) {
+                auto idx = gi.Search.SearchResults[gi.CurrentSelectedItem].ItemIndex;
+                gi.Session.SelectItem(idx);
+            }
         } else {
             gi.Session.SelectItem(gi.CurrentSelectedItem);
         }
     }
 
+    // Only the best results are kept, fetch more once the user reaches the end of them
+    if (gi.Search.IsActive() && item_count > 0 && !gi.PendingActions.ClearSearch && gi.Search.HasMoreResults()) {
+        bool scrolled_to_end = ImGui::GetScrollMaxY() > 0.0f && ImGui::GetScrollY() >= ImGui::GetScrollMaxY();
+        if (scrolled_to_end || gi.CurrentSelectedItem == item_count - 1) {
+            gi.Search.ShowMoreResults();
+        }
+    }
+
     ImGui::EndChild();
 
     gg.NextCommandPaletteActions = {};
@@ -769,6 +3086,71 @@ void CommandPalette(const char* name)
     // END this command palette
 }
 
+bool IsCommandPaletteSearching(const char* name)
+{
+    IM_ASSERT(gContext != nullptr);
+
+    if (auto ptr = gContext->Instances.GetVoidPtr(ImHashStr(name))) {
+        return reinterpret_cast<Instance*>(ptr)->Search.IsSearching();
+    }
+    return false;
+}
+
+CommandPaletteStats GetCommandPaletteStats(const char* name)
+{
+    IM_ASSERT(gContext != nullptr);
+
+    CommandPaletteStats stats;
+#if !defined(IMCMD_DISABLE_STATS)
+    if (auto ptr = gContext->Instances.GetVoidPtr(ImHashStr(name))) {
+        auto& gi = *reinterpret_cast<Instance*>(ptr);
+        stats = gi.Search.GetStats();
+        stats.LayoutTime = gi.Stats.LayoutTime;
+        stats.DrawTime = gi.Stats.DrawTime;
+        stats.VerticesEmitted = gi.Stats.VerticesEmitted;
+        stats.CommandCompactions = gi.Stats.CommandCompactions;
+    }
+#else
+    IM_UNUSED(name);
+#endif
+    return stats;
+}
+
+void ShowCommandPaletteStatsWindow(const char* name, bool* p_open)
+{
+    if (!ImGui::Begin("Command Palette Stats", p_open)) {
+        ImGui::End();
+        return;
+    }
+
+    auto stats = GetCommandPaletteStats(name);
+    ImGui::Text("Command palette: %s", name);
+#if defined(IMCMD_DISABLE_STATS)
+    ImGui::TextDisabled("Stats were disabled with IMCMD_DISABLE_STATS");
+#endif
+
+    ImGui::Separator();
+    ImGui::Text("Latest search");
+    ImGui::BulletText("Candidates scanned: %d", stats.CandidatesScanned);
+    ImGui::BulletText("Prefilter rejections: %d", stats.PrefilterRejections);
+    ImGui::BulletText("Matcher calls: %d", stats.MatcherCalls);
+    ImGui::BulletText("Matcher recursions: %d", stats.MatcherRecursions);
+    ImGui::BulletText("Results produced: %d", stats.ResultsProduced);
+    ImGui::BulletText("Search time: %.1f us", stats.SearchTime);
+    ImGui::BulletText("Sort time: %.1f us", stats.SortTime);
+    ImGui::BulletText("Results from cache: %s", stats.ResultsFromCache ? "yes" : "no");
+    ImGui::BulletText("Item changes applied: %d", stats.ItemChangesApplied);
+
+    ImGui::Separator();
+    ImGui::Text("Latest frame");
+    ImGui::BulletText("Layout time: %.1f us", stats.LayoutTime);
+    ImGui::BulletText("Draw time: %.1f us", stats.DrawTime);
+    ImGui::BulletText("Vertices emitted: %d", stats.VerticesEmitted);
+    ImGui::BulletText("Command compactions: %d", stats.CommandCompactions);
+
+    ImGui::End();
+}
+
 bool IsAnyItemSelected()
 {
     IM_ASSERT(gContext != nullptr);
@@ -844,4 +3226,60 @@ void Prompt(std::vector<std::string> options)
     auto& gi = *gContext->CurrentCommandPalette;
     gi.Session.PushOptions(std::move(options));
 }
+
+void Prompt(int count, OptionGetter getter, void* user_data)
+{
+    IM_ASSERT(gContext != nullptr);
+    IM_ASSERT(gContext->CurrentCommandPalette != nullptr);
+    IM_ASSERT(gContext->IsExecuting);
+    IM_ASSERT(!gContext->IsTerminating);
+    IM_ASSERT(count >= 0);
+    IM_ASSERT(getter != nullptr);
+
+    auto& gi = *gContext->CurrentCommandPalette;
+    gi.Session.PushOptions(count, getter, user_data);
+}
+
+OptionStream* PromptStream()
+{
+    IM_ASSERT(gContext != nullptr);
+    IM_ASSERT(gContext->CurrentCommandPalette != nullptr);
+    IM_ASSERT(gContext->IsExecuting);
+    IM_ASSERT(!gContext->IsTerminating);
+
+    auto& gi = *gContext->CurrentCommandPalette;
+    return gi.Session.PushOptionStream();
+}
+
+void AppendOptions(OptionStream* stream, std::vector<std::string> options)
+{
+    IM_ASSERT(stream != nullptr);
+    IM_ASSERT(!stream->Finished);
+    if (stream->Closed) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(stream->Mutex);
+    if (stream->PendingOptions.empty()) {
+        std::swap(stream->PendingOptions, options);
+    } else {
+        stream->PendingOptions.insert(
+            stream->PendingOptions.end(),
+            std::make_move_iterator(options.begin()),
+            std::make_move_iterator(options.end()));
+    }
+}
+
+bool IsOptionStreamClosed(OptionStream* stream)
+{
+    IM_ASSERT(stream != nullptr);
+    return stream->Closed;
+}
+
+void FinishOptions(OptionStream* stream)
+{
+    IM_ASSERT(stream != nullptr);
+    stream->Finished = true;
+    ReleaseOptionStream(stream);
+}
 } // namespace ImCmd
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "imcmd_fuzzy_search.h"
+
 #include <imgui.h>
 #include <cstddef>
 #include <cstdint>
@@ -8,7 +10,6 @@
 #include <vector>
 
 // TODO support std::string_view
-// TODO support function pointer callback in addition to std::function
 
 enum ImCmdTextType
 {
@@ -26,12 +27,22 @@ enum ImCmdTextFlag
 
 namespace ImCmd
 {
+/// Returns the text of an option of a prompt, see Prompt(int, OptionGetter, void*).
+using OptionGetter = const char* (*)(void* user_data, int option);
+
 struct Command
 {
     std::string Name;
     std::function<void()> InitialCallback;
     std::function<void(int selected_option)> SubsequentCallback;
     std::function<void()> TerminatingCallback;
+
+    // Alternatives to the callbacks above that never allocate, each is passed UserData. Whenever one of these is set,
+    // it is called instead of its std::function counterpart.
+    void (*InitialCallbackFn)(void* user_data) = nullptr;
+    void (*SubsequentCallbackFn)(void* user_data, int selected_option) = nullptr;
+    void (*TerminatingCallbackFn)(void* user_data) = nullptr;
+    void* UserData = nullptr;
 };
 
 // Initialization
@@ -48,7 +59,21 @@ Context* GetCurrentContext();
 
 // Command management
 void AddCommand(Command command);
+/// Same as calling AddCommand() on each of the commands, but much faster for large numbers of them.
+void AddCommands(std::vector<Command> commands);
 void RemoveCommand(const char* name);
+/// Looks up a command by name, case insensitive. The returned pointer is only valid until commands are added or removed.
+/// Commands added or removed while they are locked (e.g. from within a command's callback) are not reflected until the
+/// next CommandPalette() call.
+const Command* FindCommand(const char* name);
+bool HasCommand(const char* name);
+
+// Command management from any thread, e.g. plugin loaders running in the background. Unlike the functions above, these
+// don't touch the current context: the operations are queued on `context` without locking, and applied in order by
+// the next CommandPalette() call using it. `context` must outlive the calls.
+void QueueAddCommand(Context* context, Command command);
+void QueueAddCommands(Context* context, std::vector<Command> commands);
+void QueueRemoveCommand(Context* context, const char* name); //< `name` is copied
 
 // Styling
 bool GetStyleFlag(ImCmdTextType type, ImCmdTextFlag flag);
@@ -59,11 +84,36 @@ ImU32 GetStyleColor(ImCmdTextType type);
 void SetStyleColor(ImCmdTextType type, ImU32 color);
 void ClearStyleColor(ImCmdTextType type); //< Clear the style color for the given type, defaulting to ImGuiCol_Text
 
+// Searching
+FuzzySearchAlgorithm GetSearchAlgorithm();
+void SetSearchAlgorithm(FuzzySearchAlgorithm algorithm); //< Takes effect starting from the next search. Default FuzzySearchAlgorithm_Recursive.
+int GetSearchThreadCount();
+void SetSearchThreadCount(int count); //< Number of threads, including the calling one, that large searches are split across. Default 1.
+// A search that doesn't fit in the budget below is continued in the next CommandPalette() calls, showing partial results meanwhile
+int GetSearchTimeBudget();
+void SetSearchTimeBudget(int microseconds); //< Maximum time spent searching per CommandPalette() call. Default 0, i.e. unlimited.
+int GetSearchItemBudget();
+void SetSearchItemBudget(int count); //< Maximum number of items scored per CommandPalette() call. Default 0, i.e. unlimited.
+int GetMaxSearchResults();
+/// Maximum number of results kept per search, ranked with a bounded heap instead of sorting every match. Default 0, i.e. unlimited.
+/// Once the user scrolls or navigates to the end of the results, the search is redone keeping twice as many.
+void SetMaxSearchResults(int count);
+int GetSearchCacheSize();
+/// Memory each command palette may use to keep the results of its recent searches, so that deleting characters from
+/// the query or reopening it with the same text shows them right away. Default 4 MiB, 0 disables the cache.
+void SetSearchCacheSize(int bytes);
+bool GetSearchInBackground();
+/// Search on a background thread, showing the previous results until the new ones are ready. Default false.
+/// While a search is in progress, AddCommand() and RemoveCommand() are deferred. They are applied once it is done, by
+/// the next call to CommandPalette(), AddCommand(), AddCommands(), RemoveCommand() or FindCommand().
+void SetSearchInBackground(bool enabled);
+
 // Command palette widget
 void SetNextCommandPaletteSearch(const char* text);
 void SetNextCommandPaletteSearchBoxFocused();
 void CommandPalette(const char* name);
 bool IsAnyItemSelected();
+bool IsCommandPaletteSearching(const char* name); //< Whether the command palette is showing partial results of a search spanning multiple frames
 
 void RemoveCache(const char* name);
 void RemoveAllCaches();
@@ -72,7 +122,48 @@ void RemoveAllCaches();
 void SetNextWindowAffixedTop(ImGuiCond cond = 0);
 void CommandPaletteWindow(const char* name, bool* p_open);
 
+// Performance counters, define IMCMD_DISABLE_STATS when compiling imcmd_command_palette.cpp to strip them
+struct CommandPaletteStats
+{
+    // Of the latest search, accumulated over all the frames it spans
+    int CandidatesScanned = 0; //< Items considered, including the ones rejected by the prefilter
+    int PrefilterRejections = 0; //< Items skipped because they lack some character of the query altogether
+    int MatcherCalls = 0;
+    int MatcherRecursions = 0; //< Only counted by FuzzySearchAlgorithm_Recursive
+    int ResultsProduced = 0; //< Matches found, including the ones dropped because of the result limit
+    float SearchTime = 0.0f; //< Microseconds spent scoring candidates
+    float SortTime = 0.0f; //< Microseconds spent merging the ranked matches of each step into the results
+    bool ResultsFromCache = false; //< Whether the results of an identical recent search were reused, see SetSearchCacheSize()
+    int ItemChangesApplied = 0; //< Changes of the commands that the previous results were carried over through, 0 if they weren't
+
+    // Of the latest CommandPalette() call
+    float LayoutTime = 0.0f; //< Microseconds spent splitting rows into highlighted segments and measuring them
+    float DrawTime = 0.0f; //< Microseconds spent drawing rows, excluding LayoutTime
+    int VerticesEmitted = 0; //< Vertices added to the draw list for the rows
+    int CommandCompactions = 0; //< Times the items of removed commands were dropped, once for any number of RemoveCommand() calls
+};
+
+/// Returns the counters of the command palette called `name`, all zero if it doesn't exist or stats are disabled.
+CommandPaletteStats GetCommandPaletteStats(const char* name);
+/// Shows the counters of the command palette called `name` in a window, for tuning search budgets etc.
+void ShowCommandPaletteStatsWindow(const char* name, bool* p_open = nullptr);
+
 // Command responses, only call these in command callbacks (except TerminatingCallback)
 void Prompt(std::vector<std::string> options);
+/// Prompts over `count` options provided by `getter` instead of copying them. The returned strings must stay valid and
+/// unchanged until the prompt ends. `getter` may be called from other threads when searching with multiple threads or
+/// in the background.
+void Prompt(int count, OptionGetter getter, void* user_data);
+
+// Streaming prompts, the functions taking an OptionStream can be called from any thread
+struct OptionStream;
+/// Prompts over options that are appended over time with AppendOptions(), e.g. by a thread enumerating them, so that
+/// the command palette shows (and searches) the first ones right away. The returned stream must be released with
+/// FinishOptions() once done, even if the prompt has ended before that.
+OptionStream* PromptStream();
+/// Options appended after the prompt has ended are discarded.
+void AppendOptions(OptionStream* stream, std::vector<std::string> options);
+bool IsOptionStreamClosed(OptionStream* stream); //< Whether the prompt has ended, i.e. appending more options is pointless
+void FinishOptions(OptionStream* stream); //< Signals that all options were appended, and releases `stream`
 
 } // namespace ImCmd
@@ -1,36 +1,415 @@
 #include "imcmd_fuzzy_search.h"
 
-#include <cctype>
 #include <cstring>
+#include <vector>
+
+// Vectorized character search, define IMCMD_DISABLE_SIMD to always use the scalar fallback
+#if !defined(IMCMD_DISABLE_SIMD)
+#    if defined(__AVX2__)
+#        define IMCMD_SIMD_AVX2
+#        include <immintrin.h>
+#    elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#        define IMCMD_SIMD_SSE2
+#        include <emmintrin.h>
+#    endif
+#endif
+#if defined(_MSC_VER) && (defined(IMCMD_SIMD_AVX2) || defined(IMCMD_SIMD_SSE2))
+#    include <intrin.h>
+#endif
 
 namespace ImCmd
 {
 
 namespace
 {
-    bool FuzzySearchRecursive(const char* pattern, const char* src, int& outScore, const char* strBegin, const uint8_t srcMatches[], uint8_t newMatches[], int maxMatches, int& nextMatch, int& recursionCount, int recursionLimit);
+    const int sequentialBonus = 15; // bonus for adjacent matches
+    const int separatorBonus = 30; // bonus if match occurs after a separator
+    const int camelBonus = 30; // bonus if match is uppercase and prev is lower
+    const int firstLetterBonus = 15; // bonus if the first letter is matched
+
+    const int leadingLetterPenalty = -5; // penalty applied for every letter in str before the first match
+    const int maxLeadingLetterPenalty = -15; // maximum penalty for leading letters
+    const int unmatchedLetterPenalty = -1; // penalty for every letter that doesn't matter
+
+    // Offsets into the source string are stored as uint16_t
+    const int maxSrcLength = 65535;
+    // Size of the match buffers of FuzzySearchRecursive(), which also caps the number of matched characters
+    const int maxMatchBufferSize = 256;
+
+    /// Byte length of the UTF-8 encoded character at `str`, or 1 if it isn't valid UTF-8.
+    inline int GetCharLength(const char* str)
+    {
+        auto lead = static_cast<unsigned char>(str[0]);
+        int length = lead < 0xC2 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : lead < 0xF5 ? 4 : 1;
+        for (int i = 1; i < length; ++i) {
+            // Also stops at the null terminator
+            if ((static_cast<unsigned char>(str[i]) & 0xC0) != 0x80) {
+                return 1;
+            }
+        }
+        return length;
+    }
+
+    /// Number of UTF-8 encoded characters in [begin, end), i.e. of bytes that aren't continuation bytes.
+    int CountChars(const char* begin, const char* end)
+    {
+        int count = 0;
+        for (; begin != end; ++begin) {
+            count += (static_cast<unsigned char>(*begin) & 0xC0) != 0x80;
+        }
+        return count;
+    }
+
+    unsigned int FoldCodepoint(unsigned int c)
+    {
+        if (c < 0x80) {
+            return c >= 'A' && c <= 'Z' ? c + 32 : c;
+        }
+        // Latin-1 Supplement, except the multiplication sign
+        if (c >= 0xC0 && c <= 0xDE && c != 0xD7) {
+            return c + 32;
+        }
+        // Latin Extended-A and -B, Cyrillic, Latin Extended Additional: mostly uppercase letters right before their
+        // lowercase counterparts, with either the even or the odd ones being uppercase
+        bool even_upper = (c >= 0x100 && c <= 0x137 && c != 0x130) ||
+            (c >= 0x14A && c <= 0x177) ||
+            (c >= 0x1DE && c <= 0x1EF) ||
+            (c >= 0x1F8 && c <= 0x21F) ||
+            (c >= 0x222 && c <= 0x233) ||
+            (c >= 0x246 && c <= 0x24F) ||
+            (c >= 0x3D8 && c <= 0x3EF) ||
+            (c >= 0x460 && c <= 0x481) ||
+            (c >= 0x48A && c <= 0x4BF) ||
+            (c >= 0x4D0 && c <= 0x52F) ||
+            (c >= 0x1E00 && c <= 0x1E95) ||
+            (c >= 0x1EA0 && c <= 0x1EFF);
+        if (even_upper) {
+            return c % 2 == 0 ? c + 1 : c;
+        }
+        bool odd_upper = (c >= 0x139 && c <= 0x148) ||
+            (c >= 0x179 && c <= 0x17E) ||
+            (c >= 0x1CD && c <= 0x1DC) ||
+            (c >= 0x4C1 && c <= 0x4CE);
+        if (odd_upper) {
+            return c % 2 == 1 ? c + 1 : c;
+        }
+        if (c == 0x178) return 0xFF;
+        // Greek
+        if (c == 0x386) return 0x3AC;
+        if (c >= 0x388 && c <= 0x38A) return c + 37;
+        if (c == 0x38C) return 0x3CC;
+        if (c >= 0x38E && c <= 0x38F) return c + 63;
+        if (c >= 0x391 && c <= 0x3AB && c != 0x3A2) return c + 32;
+        // Cyrillic
+        if (c >= 0x400 && c <= 0x40F) return c + 80;
+        if (c >= 0x410 && c <= 0x42F) return c + 32;
+        if (c == 0x4C0) return 0x4CF;
+        // Armenian
+        if (c >= 0x531 && c <= 0x556) return c + 48;
+        // Fullwidth Latin
+        if (c >= 0xFF21 && c <= 0xFF3A) return c + 32;
+        return c;
+    }
+
+    /// Writes the case folded form of the character at `str` to `out`, returns its length in bytes (the same for both).
+    int FoldChar(const char* str, char* out)
+    {
+        auto lead = static_cast<unsigned char>(str[0]);
+        if (lead < 0x80) {
+            out[0] = lead >= 'A' && lead <= 'Z' ? static_cast<char>(lead - 'A' + 'a') : static_cast<char>(lead);
+            return 1;
+        }
+
+        int length = GetCharLength(str);
+        unsigned int c;
+        switch (length) {
+            case 2: c = (lead & 0x1Fu) << 6 | (str[1] & 0x3Fu); break;
+            case 3: c = (lead & 0x0Fu) << 12 | (str[1] & 0x3Fu) << 6 | (str[2] & 0x3Fu); break;
+            case 4: c = (lead & 0x07u) << 18 | (str[1] & 0x3Fu) << 12 | (str[2] & 0x3Fu) << 6 | (str[3] & 0x3Fu); break;
+            default: out[0] = str[0]; return 1;
+        }
+
+        unsigned int folded = FoldCodepoint(c);
+        int folded_length = folded < 0x800 ? 2 : 3;
+        if (folded == c || folded_length != length) {
+            // Also leaves overlong encodings alone
+            std::memcpy(out, str, length);
+        } else if (length == 2) {
+            out[0] = static_cast<char>(0xC0 | folded >> 6);
+            out[1] = static_cast<char>(0x80 | (folded & 0x3F));
+        } else {
+            out[0] = static_cast<char>(0xE0 | folded >> 12);
+            out[1] = static_cast<char>(0x80 | (folded >> 6 & 0x3F));
+            out[2] = static_cast<char>(0x80 | (folded & 0x3F));
+        }
+        return length;
+    }
+
+#if defined(IMCMD_SIMD_AVX2) || defined(IMCMD_SIMD_SSE2)
+    inline int CountTrailingZeros(unsigned int mask)
+    {
+#    if defined(_MSC_VER)
+        unsigned long idx;
+        _BitScanForward(&idx, mask);
+        return static_cast<int>(idx);
+#    else
+        return __builtin_ctz(mask);
+#    endif
+    }
+
+    inline int CountLeadingZeros(unsigned int mask)
+    {
+#    if defined(_MSC_VER)
+        unsigned long idx;
+        _BitScanReverse(&idx, mask);
+        return 31 - static_cast<int>(idx);
+#    else
+        return __builtin_clz(mask);
+#    endif
+    }
+#endif
+
+    /// Finds the first byte in [begin, end) that is equal to `c`, or `end` if there is none.
+    const char* FindByte(const char* begin, const char* end, char c)
+    {
+#if defined(IMCMD_SIMD_AVX2)
+        const __m256i c_x32 = _mm256_set1_epi8(c);
+        while (end - begin >= 32) {
+            __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+            unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, c_x32)));
+            if (mask != 0) {
+                return begin + CountTrailingZeros(mask);
+            }
+            begin += 32;
+        }
+#endif
+#if defined(IMCMD_SIMD_AVX2) || defined(IMCMD_SIMD_SSE2)
+        const __m128i c_x16 = _mm_set1_epi8(c);
+        while (end - begin >= 16) {
+            __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+            unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(chars, c_x16)));
+            if (mask != 0) {
+                return begin + CountTrailingZeros(mask);
+            }
+            begin += 16;
+        }
+#endif
+
+        while (begin != end) {
+            if (*begin == c) {
+                return begin;
+            }
+            ++begin;
+        }
+        return end;
+    }
+
+    /// Finds the last byte in [begin, end) that is equal to `c`, or `begin - 1` if there is none.
+    const char* FindLastByte(const char* begin, const char* end, char c)
+    {
+#if defined(IMCMD_SIMD_AVX2) || defined(IMCMD_SIMD_SSE2)
+        const __m128i c_x16 = _mm_set1_epi8(c);
+        while (end - begin >= 16) {
+            __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(end - 16));
+            unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(chars, c_x16)));
+            if (mask != 0) {
+                // `mask` only has the lower 16 bits set
+                return end - 16 + (31 - CountLeadingZeros(mask));
+            }
+            end -= 16;
+        }
+#endif
+
+        while (end != begin) {
+            --end;
+            if (*end == c) {
+                return end;
+            }
+        }
+        return begin - 1;
+    }
+
+    // The functions below work on folded strings, where matching a character is just comparing its bytes. A lead byte
+    // is never equal to a continuation byte, so searching for the first byte of a character only finds the starts of
+    // characters.
+
+    /// Finds the first occurrence in [begin, end) of the `length` bytes long character `c`, or `end` if there is none.
+    const char* FindChar(const char* begin, const char* end, const char* c, int length)
+    {
+        while (true) {
+            begin = FindByte(begin, end, c[0]);
+            if (begin == end || length == 1) {
+                return begin;
+            }
+            if (end - begin >= length && std::memcmp(begin + 1, c + 1, length - 1) == 0) {
+                return begin;
+            }
+            ++begin;
+        }
+    }
+
+    /// Finds the last occurrence of the `length` bytes long character `c` that lies entirely in [begin, end), or
+    /// `begin - 1` if there is none.
+    const char* FindLastChar(const char* begin, const char* end, const char* c, int length)
+    {
+        if (end - begin < length) {
+            return begin - 1;
+        }
+        end -= length - 1;
+        while (true) {
+            const char* found = FindLastByte(begin, end, c[0]);
+            if (found < begin || length == 1 || std::memcmp(found + 1, c + 1, length - 1) == 0) {
+                return found;
+            }
+            end = found;
+        }
+    }
+
+    /// Whether `pattern` is a subsequence of [src, srcEnd), i.e. whether it can be matched at all.
+    bool IsSubsequence(const char* pattern, const char* src, const char* srcEnd)
+    {
+        while (*pattern != '\0') {
+            int length = GetCharLength(pattern);
+            src = FindChar(src, srcEnd, pattern, length);
+            if (src == srcEnd) {
+                return false;
+            }
+            src += length;
+            pattern += length;
+        }
+        return true;
+    }
+
+    bool FuzzySearchRecursive(const char* pattern, const char* src, int& outScore, const char* strBegin, const char* strEnd, const char* originalStr, int strCharCount, const uint16_t srcMatches[], uint16_t newMatches[], int maxMatches, int& nextMatch, int& recursionCount, int recursionLimit);
+    bool FuzzySearchRecursive(const char* pattern, const char* src, const char* originalSrc, int& outScore, uint16_t matches[], int maxMatches, int& outMatches, int& recursionCount);
+    bool FuzzySearchOptimal(const char* pattern, const char* src, const char* originalSrc, int& outScore, uint16_t matches[], int maxMatches, int& outMatches);
 } // namespace
 
 bool FuzzySearch(char const* pattern, char const* haystack, int& outScore)
 {
-    uint8_t matches[256];
+    uint16_t matches[256];
     int matchCount = 0;
-    return FuzzySearch(pattern, haystack, outScore, matches, sizeof(matches), matchCount);
+    return FuzzySearch(pattern, haystack, outScore, matches, sizeof(matches) / sizeof(*matches), matchCount);
 }
 
-bool FuzzySearch(char const* pattern, char const* haystack, int& outScore, uint8_t matches[], int maxMatches, int& outMatches)
+bool FuzzySearch(char const* pattern, char const* haystack, int& outScore, uint16_t matches[], int maxMatches, int& outMatches)
+{
+    return FuzzySearch(FuzzySearchAlgorithm_Recursive, pattern, haystack, outScore, matches, maxMatches, outMatches);
+}
+
+bool FuzzySearch(FuzzySearchAlgorithm algorithm, char const* pattern, char const* haystack, int& outScore, uint16_t matches[], int maxMatches, int& outMatches, int* outRecursions)
+{
+    // Reused across calls, so that searching does not allocate per item
+    thread_local std::vector<char> foldedPattern;
+    thread_local std::vector<char> foldedHaystack;
+    foldedPattern.resize(strlen(pattern) + 1);
+    foldedHaystack.resize(strlen(haystack) + 1);
+    FuzzySearchFoldCase(pattern, foldedPattern.data());
+    FuzzySearchFoldCase(haystack, foldedHaystack.data());
+    return FuzzySearchFolded(algorithm, foldedPattern.data(), foldedHaystack.data(), haystack, outScore, matches, maxMatches, outMatches, outRecursions);
+}
+
+bool FuzzySearchFolded(FuzzySearchAlgorithm algorithm, char const* foldedPattern, char const* foldedHaystack, char const* haystack, int& outScore, uint16_t matches[], int maxMatches, int& outMatches, int* outRecursions)
 {
     int recursionCount = 0;
-    int recursionLimit = 10;
-    int newMatches = 0;
-    bool result = FuzzySearchRecursive(pattern, haystack, outScore, haystack, nullptr, matches, maxMatches, newMatches, recursionCount, recursionLimit);
-    outMatches = newMatches;
+    bool result = false;
+    switch (algorithm) {
+        case FuzzySearchAlgorithm_Recursive: result = FuzzySearchRecursive(foldedPattern, foldedHaystack, haystack, outScore, matches, maxMatches, outMatches, recursionCount); break;
+        case FuzzySearchAlgorithm_Optimal: result = FuzzySearchOptimal(foldedPattern, foldedHaystack, haystack, outScore, matches, maxMatches, outMatches); break;
+    }
+    if (outRecursions) {
+        *outRecursions = recursionCount;
+    }
     return result;
 }
 
+void FuzzySearchFoldCase(char const* str, char* out)
+{
+    while (*str != '\0') {
+        int length = FoldChar(str, out);
+        str += length;
+        out += length;
+    }
+    *out = '\0';
+}
+
+uint64_t FuzzySearchSignature(char const* str)
+{
+    uint64_t signature = 0;
+    char folded[4];
+    while (*str != '\0') {
+        int length = FoldChar(str, folded);
+        for (int i = 0; i < length; ++i) {
+            int c = (unsigned char)folded[i];
+            int bit;
+            if (c >= 'a' && c <= 'z') {
+                // Bits 0-25: one for each letter
+                bit = c - 'a';
+            } else if (c >= '0' && c <= '9') {
+                // Bits 26-35: one for each digit
+                bit = 26 + (c - '0');
+            } else {
+                // Bits 36-63: everything else (including each byte of non-ASCII characters) shares the remaining bits
+                bit = 36 + c % 28;
+            }
+            signature |= (uint64_t)1 << bit;
+        }
+        str += length;
+    }
+    return signature;
+}
+
 namespace
 {
-    bool FuzzySearchRecursive(const char* pattern, const char* src, int& outScore, const char* strBegin, const uint8_t srcMatches[], uint8_t newMatches[], int maxMatches, int& nextMatch, int& recursionCount, int recursionLimit)
+    // Bonus for matching the character at `idx`, excluding the sequential bonus which depends on the previous match.
+    // Looks at the original string, since camel case is lost once folded.
+    int PositionBonus(const char* str, int idx)
+    {
+        if (idx == 0) {
+            return firstLetterBonus;
+        }
+
+        // Separators and camel case humps are ASCII-only, so looking at the previous byte is enough. Not using
+        // islower() and isupper(), which depend on the C locale.
+        int bonus = 0;
+        char neighbor = str[idx - 1];
+        char curr = str[idx];
+        if (neighbor >= 'a' && neighbor <= 'z' && curr >= 'A' && curr <= 'Z') {
+            bonus += camelBonus;
+        }
+        if (neighbor == '_' || neighbor == ' ') {
+            bonus += separatorBonus;
+        }
+        return bonus;
+    }
+
+    int LeadingLetterPenalty(int leadingChars)
+    {
+        int penalty = leadingLetterPenalty * leadingChars;
+        return penalty < maxLeadingLetterPenalty ? maxLeadingLetterPenalty : penalty;
+    }
+
+    bool FuzzySearchRecursive(const char* pattern, const char* haystack, const char* originalHaystack, int& outScore, uint16_t matches[], int maxMatches, int& outMatches, int& recursionCount)
+    {
+        // Reject non-matches with a linear scan before paying for the recursion
+        size_t haystackLen = strlen(haystack);
+        const char* haystackEnd = haystack + (haystackLen < (size_t)maxSrcLength ? haystackLen : (size_t)maxSrcLength);
+        if (!IsSubsequence(pattern, haystack, haystackEnd)) {
+            return false;
+        }
+
+        if (maxMatches > maxMatchBufferSize) {
+            maxMatches = maxMatchBufferSize;
+        }
+        int recursionLimit = 10;
+        int newMatches = 0;
+        int charCount = CountChars(haystack, haystackEnd);
+        bool result = FuzzySearchRecursive(pattern, haystack, outScore, haystack, haystackEnd, originalHaystack, charCount, nullptr, matches, maxMatches, newMatches, recursionCount, recursionLimit);
+        outMatches = newMatches;
+        return result;
+    }
+
+    bool FuzzySearchRecursive(const char* pattern, const char* src, int& outScore, const char* strBegin, const char* strEnd, const char* originalStr, int strCharCount, const uint16_t srcMatches[], uint16_t newMatches[], int maxMatches, int& nextMatch, int& recursionCount, int recursionLimit)
     {
         // Count recursions
         ++recursionCount;
@@ -39,49 +418,53 @@ namespace
         }
 
         // Detect end of strings
-        if (*pattern == '\0' || *src == '\0') {
+        if (*pattern == '\0' || src >= strEnd) {
             return false;
         }
 
         // Recursion params
         bool recursiveMatch = false;
-        uint8_t bestRecursiveMatches[256];
+        uint16_t bestRecursiveMatches[maxMatchBufferSize];
         int bestRecursiveScore = 0;
 
         // Loop through pattern and str looking for a match
         bool firstMatch = true;
-        while (*pattern != '\0' && *src != '\0') {
-            // Found match
-            if (tolower(*pattern) == tolower(*src)) {
-                // Supplied matches buffer was too short
-                if (nextMatch >= maxMatches) {
-                    return false;
-                }
+        while (*pattern != '\0') {
+            // Jump to the next match
+            int charLength = GetCharLength(pattern);
+            src = FindChar(src, strEnd, pattern, charLength);
+            if (src == strEnd) {
+                break;
+            }
 
-                // "Copy-on-Write" srcMatches into matches
-                if (firstMatch && srcMatches) {
-                    memcpy(newMatches, srcMatches, nextMatch);
-                    firstMatch = false;
-                }
+            // Supplied matches buffer was too short
+            if (nextMatch >= maxMatches) {
+                return false;
+            }
 
-                // Recursive call that "skips" this match
-                uint8_t recursiveMatches[256];
-                int recursiveScore;
-                int recursiveNextMatch = nextMatch;
-                if (FuzzySearchRecursive(pattern, src + 1, recursiveScore, strBegin, newMatches, recursiveMatches, sizeof(recursiveMatches), recursiveNextMatch, recursionCount, recursionLimit)) {
-                    // Pick the best recursive score
-                    if (!recursiveMatch || recursiveScore > bestRecursiveScore) {
-                        memcpy(bestRecursiveMatches, recursiveMatches, 256);
-                        bestRecursiveScore = recursiveScore;
-                    }
-                    recursiveMatch = true;
-                }
+            // "Copy-on-Write" srcMatches into matches
+            if (firstMatch && srcMatches) {
+                memcpy(newMatches, srcMatches, nextMatch * sizeof(uint16_t));
+                firstMatch = false;
+            }
 
-                // Advance
-                newMatches[nextMatch++] = (uint8_t)(src - strBegin);
-                ++pattern;
+            // Recursive call that "skips" this match
+            uint16_t recursiveMatches[maxMatchBufferSize];
+            int recursiveScore;
+            int recursiveNextMatch = nextMatch;
+            if (FuzzySearchRecursive(pattern, src + 1, recursiveScore, strBegin, strEnd, originalStr, strCharCount, newMatches, recursiveMatches, maxMatches, recursiveNextMatch, recursionCount, recursionLimit)) {
+                // Pick the best recursive score
+                if (!recursiveMatch || recursiveScore > bestRecursiveScore) {
+                    memcpy(bestRecursiveMatches, recursiveMatches, maxMatches * sizeof(uint16_t));
+                    bestRecursiveScore = recursiveScore;
+                }
+                recursiveMatch = true;
             }
-            ++src;
+
+            // Advance
+            newMatches[nextMatch++] = (uint16_t)(src - strBegin);
+            pattern += charLength;
+            src += charLength;
         }
 
         // Determine if full pattern was matched
@@ -89,71 +472,37 @@ namespace
 
         // Calculate score
         if (matched) {
-            const int sequentialBonus = 15; // bonus for adjacent matches
-            const int separatorBonus = 30; // bonus if match occurs after a separator
-            const int camelBonus = 30; // bonus if match is uppercase and prev is lower
-            const int firstLetterBonus = 15; // bonus if the first letter is matched
-
-            const int leadingLetterPenalty = -5; // penalty applied for every letter in str before the first match
-            const int maxLeadingLetterPenalty = -15; // maximum penalty for leading letters
-            const int unmatchedLetterPenalty = -1; // penalty for every letter that doesn't matter
-
-            // Iterate str to end
-            while (*src != '\0') {
-                ++src;
-            }
-
             // Initialize score
             outScore = 100;
 
             // Apply leading letter penalty
-            int penalty = leadingLetterPenalty * newMatches[0];
-            if (penalty < maxLeadingLetterPenalty) {
-                penalty = maxLeadingLetterPenalty;
-            }
-            outScore += penalty;
+            outScore += LeadingLetterPenalty(CountChars(strBegin, strBegin + newMatches[0]));
 
             // Apply unmatched penalty
-            int unmatched = (int)(src - strBegin) - nextMatch;
+            int unmatched = strCharCount - nextMatch;
             outScore += unmatchedLetterPenalty * unmatched;
 
             // Apply ordering bonuses
             for (int i = 0; i < nextMatch; ++i) {
-                uint8_t currIdx = newMatches[i];
+                int currIdx = newMatches[i];
 
                 if (i > 0) {
-                    uint8_t prevIdx = newMatches[i - 1];
+                    int prevIdx = newMatches[i - 1];
 
                     // Sequential
-                    if (currIdx == (prevIdx + 1))
+                    if (currIdx == prevIdx + GetCharLength(strBegin + prevIdx))
                         outScore += sequentialBonus;
                 }
 
                 // Check for bonuses based on neighbor character value
-                if (currIdx > 0) {
-                    // Camel case
-                    char neighbor = strBegin[currIdx - 1];
-                    char curr = strBegin[currIdx];
-                    if (::islower(neighbor) && ::isupper(curr)) {
-                        outScore += camelBonus;
-                    }
-
-                    // Separator
-                    bool neighborSeparator = neighbor == '_' || neighbor == ' ';
-                    if (neighborSeparator) {
-                        outScore += separatorBonus;
-                    }
-                } else {
-                    // First letter
-                    outScore += firstLetterBonus;
-                }
+                outScore += PositionBonus(originalStr, currIdx);
             }
         }
 
         // Return best result
         if (recursiveMatch && (!matched || bestRecursiveScore > outScore)) {
             // Recursive score is better than "this"
-            memcpy(newMatches, bestRecursiveMatches, maxMatches);
+            memcpy(newMatches, bestRecursiveMatches, maxMatches * sizeof(uint16_t));
             outScore = bestRecursiveScore;
             return true;
         } else if (matched) {
@@ -164,5 +513,160 @@ namespace
             return false;
         }
     }
+
+    // Computes the same score as FuzzySearchRecursive(), but for the best possible alignment instead of the best one
+    // found within the recursion limit.
+    //
+    // Let M[i][j] be the best score of matching pattern[0..i] with pattern[i] matched at src[j], and L the length of
+    // pattern[i-1]. Then
+    //     M[i][j] = PositionBonus(j) + max(M[i-1][j-L] + sequentialBonus, max(M[i-1][k] for k < j-L))
+    // Each pattern[i] can only ever be matched between its earliest (greedy forward) and latest (greedy backward)
+    // possible position, so only that window of each row is computed and stored. `i` counts characters, `j` bytes.
+    bool FuzzySearchOptimal(const char* pattern, const char* src, const char* originalSrc, int& outScore, uint16_t matches[], int maxMatches, int& outMatches)
+    {
+        const int none = -(1 << 29);
+
+        int patternBytes = static_cast<int>(strlen(pattern));
+        int patternLen = CountChars(pattern, pattern + patternBytes);
+        int srcLen = static_cast<int>(strlen(src));
+        if (srcLen > maxSrcLength) {
+            srcLen = maxSrcLength;
+        }
+        if (patternLen == 0 || patternBytes > srcLen || patternLen > maxMatches) {
+            return false;
+        }
+
+        // Scratch memory, reused across calls so that a search does not allocate per item.
+        // Layout: [first: patternLen][last: patternLen][rowOffset: patternLen][charOffset: patternLen + 1][M rows: sum of window widths]
+        const int headerSize = patternLen * 4 + 1;
+        thread_local std::vector<int> scratch;
+        scratch.resize(headerSize);
+        int* first = scratch.data();
+        int* last = first + patternLen;
+        int* charOffset = last + patternLen * 2;
+
+        // Where each pattern character starts, the last entry is the end of the pattern
+        for (int i = 0, offset = 0; i <= patternLen; ++i) {
+            charOffset[i] = offset;
+            if (i < patternLen) {
+                offset += GetCharLength(pattern + offset);
+            }
+        }
+
+        // Earliest possible position of each pattern character, this also rejects non-matches
+        const char* srcEnd = src + srcLen;
+        const char* cursor = src;
+        for (int i = 0; i < patternLen; ++i) {
+            int length = charOffset[i + 1] - charOffset[i];
+            cursor = FindChar(cursor, srcEnd, pattern + charOffset[i], length);
+            if (cursor == srcEnd) {
+                return false;
+            }
+            first[i] = static_cast<int>(cursor - src);
+            cursor += length;
+        }
+
+        // Latest possible position of each pattern character
+        cursor = srcEnd;
+        for (int i = patternLen - 1; i >= 0; --i) {
+            cursor = FindLastChar(src, cursor, pattern + charOffset[i], charOffset[i + 1] - charOffset[i]);
+            last[i] = static_cast<int>(cursor - src);
+        }
+
+        int cellCount = 0;
+        for (int i = 0; i < patternLen; ++i) {
+            scratch[patternLen * 2 + i] = cellCount;
+            cellCount += last[i] - first[i] + 1;
+        }
+        scratch.resize(headerSize + cellCount);
+        first = scratch.data();
+        last = first + patternLen;
+        const int* rowOffset = last + patternLen;
+        charOffset = last + patternLen * 2;
+        int* cells = scratch.data() + headerSize;
+
+        // Access M[i][j], only valid for first[i] <= j <= last[i]
+        auto M = [&](int i, int j) -> int& {
+            return cells[rowOffset[i] + (j - first[i])];
+        };
+        // Length of pattern[i]
+        auto L = [&](int i) -> int {
+            return charOffset[i + 1] - charOffset[i];
+        };
+        // Whether pattern[i] occurs at src[j]
+        auto MatchesAt = [&](int i, int j) -> bool {
+            return std::memcmp(src + j, pattern + charOffset[i], L(i)) == 0;
+        };
+
+        int leadingChars = CountChars(src, src + first[0]);
+        for (int j = first[0]; j <= last[0]; ++j) {
+            if (j > first[0] && (static_cast<unsigned char>(src[j - 1]) & 0xC0) != 0x80) {
+                ++leadingChars;
+            }
+            if (!MatchesAt(0, j)) {
+                M(0, j) = none;
+                continue;
+            }
+            M(0, j) = PositionBonus(originalSrc, j) + LeadingLetterPenalty(leadingChars);
+        }
+
+        for (int i = 1; i < patternLen; ++i) {
+            int prevLength = L(i - 1);
+            int prevBest = none; // max(M[i-1][k] for k < j-prevLength)
+            int k = first[i - 1];
+            for (int j = first[i]; j <= last[i]; ++j) {
+                while (k < j - prevLength && k <= last[i - 1]) {
+                    prevBest = M(i - 1, k) > prevBest ? M(i - 1, k) : prevBest;
+                    ++k;
+                }
+
+                if (!MatchesAt(i, j)) {
+                    M(i, j) = none;
+                    continue;
+                }
+
+                int best = prevBest;
+                if (j - prevLength <= last[i - 1] && M(i - 1, j - prevLength) != none) {
+                    int sequential = M(i - 1, j - prevLength) + sequentialBonus;
+                    best = sequential > best ? sequential : best;
+                }
+                M(i, j) = best == none ? none : best + PositionBonus(originalSrc, j);
+            }
+        }
+
+        // Pick the best position for the last pattern character, then walk back to recover the rest
+        int bestIdx = -1;
+        for (int j = first[patternLen - 1]; j <= last[patternLen - 1]; ++j) {
+            if (M(patternLen - 1, j) != none && (bestIdx == -1 || M(patternLen - 1, j) > M(patternLen - 1, bestIdx))) {
+                bestIdx = j;
+            }
+        }
+
+        outScore = 100 + M(patternLen - 1, bestIdx) + unmatchedLetterPenalty * (CountChars(src, srcEnd) - patternLen);
+
+        int j = bestIdx;
+        for (int i = patternLen - 1; i >= 0; --i) {
+            matches[i] = (uint16_t)j;
+            if (i == 0) {
+                break;
+            }
+
+            // Find a previous match that produces M[i][j], preferring the sequential one
+            int prevLength = L(i - 1);
+            int target = M(i, j) - PositionBonus(originalSrc, j);
+            if (j - prevLength <= last[i - 1] && M(i - 1, j - prevLength) != none && M(i - 1, j - prevLength) + sequentialBonus == target) {
+                j = j - prevLength;
+            } else {
+                int k = j - prevLength - 1 < last[i - 1] ? j - prevLength - 1 : last[i - 1];
+                while (M(i - 1, k) != target) {
+                    --k;
+                }
+                j = k;
+            }
+        }
+
+        outMatches = patternLen;
+        return true;
+    }
 } // namespace
 } // namespace ImCmd
@@ -6,7 +6,34 @@
 namespace ImCmd
 {
 
+enum FuzzySearchAlgorithm
+{
+    /// lib_fts's recursive matcher. Gives up after a fixed number of recursions, so it might miss the best scoring match
+    /// on long or repetitive strings.
+    FuzzySearchAlgorithm_Recursive,
+    /// Dynamic programming matcher with the same scoring. Always finds the best scoring match, without recursion and in
+    /// at most O(pattern * src) time.
+    FuzzySearchAlgorithm_Optimal,
+};
+
+// Strings are UTF-8 and compared case-insensitively, see FuzzySearchFoldCase(). `matches` receives the byte offset in
+// `src` of each matched character of `pattern`, only the first 65535 bytes of `src` are searched.
 bool FuzzySearch(char const* pattern, char const* src, int& outScore);
-bool FuzzySearch(char const* pattern, char const* src, int& outScore, uint8_t matches[], int maxMatches, int& outMatches);
+bool FuzzySearch(char const* pattern, char const* src, int& outScore, uint16_t matches[], int maxMatches, int& outMatches);
+/// If `outRecursions` is not null, it is set to the number of recursions FuzzySearchAlgorithm_Recursive went through
+/// (0 for the other algorithms, or if `src` was rejected before even trying).
+bool FuzzySearch(FuzzySearchAlgorithm algorithm, char const* pattern, char const* src, int& outScore, uint16_t matches[], int maxMatches, int& outMatches, int* outRecursions = nullptr);
+/// Same as FuzzySearch(), but over a pattern and a source string that were already folded with FuzzySearchFoldCase(),
+/// which saves folding them on every call. `src` is needed as well, since scoring depends on its case.
+bool FuzzySearchFolded(FuzzySearchAlgorithm algorithm, char const* foldedPattern, char const* foldedSrc, char const* src, int& outScore, uint16_t matches[], int maxMatches, int& outMatches, int* outRecursions = nullptr);
+
+/// Writes the case folded form of `str` to `out`, which must have room for `strlen(str) + 1` chars. Folding maps
+/// uppercase Latin, Greek, Cyrillic, Armenian and fullwidth Latin letters to lowercase, and only where that keeps the
+/// UTF-8 encoded length, so that offsets into the folded string are offsets into `str` too.
+void FuzzySearchFoldCase(char const* str, char* out);
+
+/// Case-insensitive set of characters present in `str`, as a bitmask.
+/// `pattern` can only match `src` if `(FuzzySearchSignature(pattern) & ~FuzzySearchSignature(src)) == 0`.
+uint64_t FuzzySearchSignature(char const* str);
 
 } // namespace ImCmd